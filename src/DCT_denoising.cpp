@@ -27,6 +27,9 @@
 /*---------------------------------------------------------------------------*/
 
 #include <Rcpp.h>
+#include <cstring>
+#include <string>
+#include "DCT_kernels.h"
 
 # define PATCHSIZE8 8
 
@@ -110,13 +113,13 @@ const double DCTbasis8[PATCHSIZE8][PATCHSIZE8] = {
 
 // 1D DCT transform of a signal of size 8x1.
 // flag: 1/-1 forward/inverse transforms.
-void DCT1D(std::vector< double >& in, std::vector< double >& out, int flag)
+void DCT1D(const double* in, double* out, int flag)
 {
     // forward transform
     if (flag == 1) 
     {
         for (int j = 0; j < PATCHSIZE8; ++j) 
-    {
+        {
             out[j] = 0;
             for (int i = 0; i < PATCHSIZE8; ++i) 
             {
@@ -128,7 +131,7 @@ void DCT1D(std::vector< double >& in, std::vector< double >& out, int flag)
     else if (flag == -1) 
     {
         for (int j = 0; j < PATCHSIZE8; ++j) 
-       {
+        {
             out[j] = 0;
             for (int i = 0; i < PATCHSIZE8; ++i) 
             {
@@ -138,25 +141,18 @@ void DCT1D(std::vector< double >& in, std::vector< double >& out, int flag)
     }
 }
 
-
-// 2D DCT of a 8x8 patches. The result is restored in-place.
+// 2D DCT of a 8x8 patch stored row by row in a flat array.
+// The result is restored in-place.
 // flag: 1/-1 forward/inverse transforms.
-void DCT2D(std::vector< std::vector< double > >& patch1, int flag)
+void DCT2D(double* patch1, int flag)
 {
-    std::vector< std::vector< double > > tmp1;
-    tmp1.resize(PATCHSIZE8);
-    std::vector< std::vector< double > > tmp2;
-    tmp2.resize(PATCHSIZE8);
-    for (int i = 0; i < PATCHSIZE8; ++i) 
-    {
-        tmp1[i].resize(PATCHSIZE8);
-        tmp2[i].resize(PATCHSIZE8);
-    }
+    double tmp1[PATCHSIZE8 * PATCHSIZE8];
+    double tmp2[PATCHSIZE8 * PATCHSIZE8];
 
     // transform row by row
     for (int j = 0; j < PATCHSIZE8; ++j) 
     {
-        DCT1D(patch1[j], tmp1[j], flag);
+        DCT1D(patch1 + j * PATCHSIZE8, tmp1 + j * PATCHSIZE8, flag);
     }
 
     // transform column by column
@@ -167,18 +163,18 @@ void DCT2D(std::vector< std::vector< double > >& patch1, int flag)
     {
         for (int i = 0; i < PATCHSIZE8; ++i)
         {
-            tmp2[j][i] = tmp1[i][j];
+            tmp2[j * PATCHSIZE8 + i] = tmp1[i * PATCHSIZE8 + j];
         }
     }
     for (int j = 0; j < PATCHSIZE8; ++j) 
     {
-        DCT1D(tmp2[j], tmp1[j], flag);
+        DCT1D(tmp2 + j * PATCHSIZE8, tmp1 + j * PATCHSIZE8, flag);
     }
     for (int j = 0; j < PATCHSIZE8; ++j) 
     {
         for (int i = 0; i < PATCHSIZE8; ++i)
         {
-            patch1[j][i] = tmp1[i][j];
+            patch1[j * PATCHSIZE8 + i] = tmp1[i * PATCHSIZE8 + j];
         }
     }
 }
@@ -494,9 +490,9 @@ const double DCTbasis16[PATCHSIZE16][PATCHSIZE16] = {
 };
 
 
-// 1D DCT transform of a signal of size 8x1.
+// 1D DCT transform of a signal of size 16x1.
 // flag: 1/-1 forward/inverse transforms.
-void DCT1D16(std::vector< double >& in, std::vector< double >& out, int flag)
+void DCT1D16(const double* in, double* out, int flag)
 {
     // forward transform
     if (flag == 1) 
@@ -524,25 +520,18 @@ void DCT1D16(std::vector< double >& in, std::vector< double >& out, int flag)
     }
 }
 
-
-// 2D DCT of a 16x16 patches. The result is restored in-place.
+// 2D DCT of a 16x16 patch stored row by row in a flat array.
+// The result is restored in-place.
 // flag: 1/-1 forward/inverse transforms.
-void DCT2D16x16(std::vector< std::vector< double > >& patch1, int flag)
+void DCT2D16x16(double* patch1, int flag)
 {
-    std::vector< std::vector< double > > tmp1;
-    tmp1.resize(PATCHSIZE16);
-    std::vector< std::vector< double > > tmp2;
-    tmp2.resize(PATCHSIZE16);
-    for (int i = 0; i < PATCHSIZE16; ++i) 
-    {
-        tmp1[i].resize(PATCHSIZE16);
-        tmp2[i].resize(PATCHSIZE16);
-    }
+    double tmp1[PATCHSIZE16 * PATCHSIZE16];
+    double tmp2[PATCHSIZE16 * PATCHSIZE16];
 
     // transform row by row
     for (int j = 0; j < PATCHSIZE16; ++j) 
     {
-        DCT1D16(patch1[j], tmp1[j], flag);
+        DCT1D16(patch1 + j * PATCHSIZE16, tmp1 + j * PATCHSIZE16, flag);
     }
 
     // transform column by column
@@ -553,18 +542,18 @@ void DCT2D16x16(std::vector< std::vector< double > >& patch1, int flag)
     {
         for (int i = 0; i < PATCHSIZE16; ++i)
         {
-            tmp2[j][i] = tmp1[i][j];
+            tmp2[j * PATCHSIZE16 + i] = tmp1[i * PATCHSIZE16 + j];
         }
     }
     for (int j = 0; j < PATCHSIZE16; ++j) 
     {
-        DCT1D16(tmp2[j], tmp1[j], flag);
+        DCT1D16(tmp2 + j * PATCHSIZE16, tmp1 + j * PATCHSIZE16, flag);
     }
     for (int j = 0; j < PATCHSIZE16; ++j) 
     {
-        for (int i = 0; i < PATCHSIZE16; ++i) 
+        for (int i = 0; i < PATCHSIZE16; ++i)
         {
-            patch1[j][i] = tmp1[i][j];
+            patch1[j * PATCHSIZE16 + i] = tmp1[i * PATCHSIZE16 + j];
         }
     }
 }
@@ -600,6 +589,9 @@ void DCT2D16x16(std::vector< std::vector< double > >& patch1, int flag)
 
 #define ABS(x)    (((x) > 0) ? (x) : (-(x)))
 
+// number of rows of patch positions denoised by one thread at a time
+#define STRIPE_HEIGHT 32
+
 // Define a 3x3 1D DCT basis (each ROW is a vector of the forward
 // transform basis).
 /*
@@ -619,17 +611,422 @@ const double DCTbasis3x3[3][3] = {
 };
 */
 
-void Image2Patches(std::vector<double>&, 
-     std::vector< std::vector< std::vector< std::vector< double > > > >&, int, int, int, int, int);
-void Patches2Image(std::vector<double>&, 
-     std::vector< std::vector< std::vector< std::vector< double > > > >&, int, int, int, int, int);
+// Fast 1D DCT of a signal of size 8x1 by even-odd decomposition of the basis.
+// It needs 22 multiplications instead of 64 for the forward transform.
+// in_stride, out_stride: distances between consecutive samples.
+// flag: 1/-1 forward/inverse transforms.
+void DCT1D_fast(const double* in, int in_stride, double* out, int out_stride, int flag)
+{
+    if (flag == 1)
+    {
+        double s0 = in[0] + in[7 * in_stride];
+        double s1 = in[in_stride] + in[6 * in_stride];
+        double s2 = in[2 * in_stride] + in[5 * in_stride];
+        double s3 = in[3 * in_stride] + in[4 * in_stride];
+        double d0 = in[0] - in[7 * in_stride];
+        double d1 = in[in_stride] - in[6 * in_stride];
+        double d2 = in[2 * in_stride] - in[5 * in_stride];
+        double d3 = in[3 * in_stride] - in[4 * in_stride];
+        double ss03 = s0 + s3;
+        double ss12 = s1 + s2;
+        double sd03 = s0 - s3;
+        double sd12 = s1 - s2;
+        out[0] = DCTbasis8[0][0] * (ss03 + ss12);
+        out[4 * out_stride] = DCTbasis8[4][0] * (ss03 - ss12);
+        out[2 * out_stride] = DCTbasis8[2][0] * sd03 + DCTbasis8[2][1] * sd12;
+        out[6 * out_stride] = DCTbasis8[6][0] * sd03 + DCTbasis8[6][1] * sd12;
+        for (int k = 1; k < PATCHSIZE8; k += 2)
+        {
+            out[k * out_stride] = DCTbasis8[k][0] * d0 + DCTbasis8[k][1] * d1 + DCTbasis8[k][2] * d2 + DCTbasis8[k][3] * d3;
+        }
+    }
+    else if (flag == -1)
+    {
+        double a = DCTbasis8[0][0] * in[0];
+        double b = DCTbasis8[4][0] * in[4 * in_stride];
+        double t0 = DCTbasis8[2][0] * in[2 * in_stride] + DCTbasis8[6][0] * in[6 * in_stride];
+        double t1 = DCTbasis8[2][1] * in[2 * in_stride] + DCTbasis8[6][1] * in[6 * in_stride];
+        double e[4];
+        e[0] = (a + b) + t0;
+        e[3] = (a + b) - t0;
+        e[1] = (a - b) + t1;
+        e[2] = (a - b) - t1;
+        for (int n = 0; n < 4; ++n)
+        {
+            double o = DCTbasis8[1][n] * in[in_stride] + DCTbasis8[3][n] * in[3 * in_stride] + DCTbasis8[5][n] * in[5 * in_stride] + DCTbasis8[7][n] * in[7 * in_stride];
+            out[n * out_stride] = e[n] + o;
+            out[(7 - n) * out_stride] = e[n] - o;
+        }
+    }
+}
+
+// Transforms used by DCTdenoising_stream.
+// The transforms are written as products with the basis matrix and its 
+// transpose so that they run on the SIMD kernels of DCT_kernels.cpp.
+// 8x8 patches are transformed by DCT1D_fast instead when the kernel processes
+// at most two doubles at once, since the butterflies are faster in that case.
+struct DCTdenoising_transform
+{
+    int n;
+    bool flag_fast;
+    DCT_matmul_kernel matmul;
+    const double* basis;
+    double basisT[PATCHSIZE16 * PATCHSIZE16];
+
+    DCTdenoising_transform(int flag_dct16x16, const DCT_kernel& kernel)
+    {
+        n = flag_dct16x16 == 0 ? PATCHSIZE16 : PATCHSIZE8;
+        basis = flag_dct16x16 == 0 ? &DCTbasis16[0][0] : &DCTbasis8[0][0];
+        matmul = kernel.matmul;
+        flag_fast = n == PATCHSIZE8 && kernel.width <= 2;
+        for (int i = 0; i < n; ++i)
+        {
+            for (int j = 0; j < n; ++j)
+            {
+                basisT[i * n + j] = basis[j * n + i];
+            }
+        }
+    }
+
+    // Forward 1D DCT of every column of a strip of n rows and width columns.
+    // colcoef[k * width + x] is the k-th coefficient of column x.
+    // Horizontally adjacent patches share all but one of their columns, so the
+    // column transforms computed here are reused by every patch of the strip.
+    void columns_strip(const double* strip, int width, double* colcoef) const
+    {
+        if (flag_fast)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                DCT1D_fast(strip + x, width, colcoef + x, width, 1);
+            }
+        } else {
+            matmul(basis, n, strip, width, colcoef, width, n, n, width);
+        }
+    }
+
+    // Forward 1D DCT of the n rows of the n x n block of colcoef starting at 
+    // column i. Together with columns_strip, this yields the 2D DCT of the 
+    // patch in the same layout as DCT2D and DCT2D16x16.
+    void rows_patch(const double* colcoef, int width, int i, double* patch) const
+    {
+        if (flag_fast)
+        {
+            for (int k = 0; k < n; ++k)
+            {
+                DCT1D_fast(colcoef + k * width + i, 1, patch + k * n, 1, 1);
+            }
+        } else {
+            matmul(colcoef + i, width, basisT, n, patch, n, n, n, n);
+        }
+    }
+
+    // 2D inverse DCT of a patch. The result is restored in-place.
+    // tmp: scratch block of n x n.
+    void inverse(double* patch, double* tmp) const
+    {
+        if (flag_fast)
+        {
+            for (int k = 0; k < n; ++k)
+            {
+                DCT1D_fast(patch + k * n, 1, tmp + k * n, 1, -1);
+            }
+            for (int k = 0; k < n; ++k)
+            {
+                DCT1D_fast(tmp + k, n, patch + k, n, -1);
+            }
+        } else {
+            matmul(patch, n, basis, n, tmp, n, n, n, n);
+            matmul(basisT, n, tmp, n, patch, n, n, n, n);
+        }
+    }
+};
+
+// Denoise the patches of size width_p x height_p whose top-left corners lie in
+// the rows rows[k_begin], ..., rows[k_end-1] and the columns cols one at a time.
+// The denoised patches are accumulated into stripe_sum, which holds the image
+// rows from rows[k_begin] on.
+// The forward transform is computed in sliding-window mode: the column 
+// transforms of each row of patches are computed once and shared by all the 
+// patches of that row, which roughly halves the cost of the forward DCT.
+// colcoef, patch, tmp: scratch blocks of height_p x width, and width_p x height_p.
+void DCTdenoising_stripe(const std::vector<double>& ipixels, double* stripe_sum, int width, const std::vector<int>& rows, int k_begin, int k_end, const std::vector<int>& cols, int width_p, int height_p, double Th, const DCTdenoising_transform& transform, double* colcoef, double* patch, double* tmp)
+{
+    int size_p = width_p * height_p;
+    int num_cols = cols.size();
+
+    // Loop over the patch positions
+    for (int k = k_begin; k < k_end; ++k)
+    {
+        int j = rows[k];
+        transform.columns_strip(&ipixels[j*width], width, colcoef);
+        for (int l = 0; l < num_cols; ++l) 
+        {
+            int i = cols[l];
+
+            // 2D DCT forward
+            transform.rows_patch(colcoef, width, i, patch);
+
+            // Thresholding
+            for (int p = 0; p < size_p; ++p)
+            {
+                patch[p] = ABS(patch[p]) < Th ? 0 : patch[p];
+            }
+
+            // 2D DCT inverse
+            transform.inverse(patch, tmp);
+
+            for (int jp = 0; jp < height_p; ++jp)
+            {
+                double* dst = stripe_sum + (j-rows[k_begin]+jp)*width + i;
+                for (int ip = 0; ip < width_p; ++ip) 
+                {
+                    dst[ip] += patch[jp*width_p + ip];
+                }
+            }
+        }
+    }
+}
+
+// Positions of the patches of size n along a line of size pixels:
+// 0, step, 2 x step, ..., and size - n, so that the last pixels are covered
+// whatever step is.
+std::vector<int> DCTdenoising_positions(int size, int n, int step)
+{
+    std::vector<int> res;
+    for (int j = 0; j < size - n + 1; j += step)
+    {
+        res.push_back(j);
+    }
+    if (res.back() != size - n)
+    {
+        res.push_back(size - n);
+    }
+    return res;
+}
+
+// Number of patches of size n at the given positions covering each of the 
+// size pixels of a line.
+std::vector<double> DCTdenoising_coverage(int size, int n, const std::vector<int>& positions)
+{
+    std::vector<double> res(size, 0.0);
+    for (size_t k = 0; k < positions.size(); ++k)
+    {
+        for (int jp = 0; jp < n; ++jp)
+        {
+            ++res[positions[k]+jp];
+        }
+    }
+    return res;
+}
+
+// Denoise an image with sliding DCT thresholding, keeping the memory 
+// footprint O(width x height) instead of O(width x height x width_p x height_p).
+// Patches are taken every step pixels in both directions (plus the last row
+// and column of positions). step = 1 is the full sliding window; larger steps
+// trade quality for speed roughly as 1 / step^2.
+// The rows of patch positions are split into stripes of STRIPE_HEIGHT rows.
+// Each stripe is denoised by one thread into its own buffer, and the buffers
+// are added to opixels in the order of the stripes. The stripes do not depend
+// on nthreads, so the result is the same whatever the number of threads.
+// The weight of a pixel is the number of patches covering it, which is the
+// product of the coverages of its row and its column. Since step <= patch size
+// is enforced by the caller, every pixel is covered at least once.
+void DCTdenoising_stream(const std::vector<double>& ipixels, std::vector<double>& opixels, int width, int height, int width_p, int height_p, double Th, int flag_dct16x16, int step, int nthreads)
+{
+    int size = width * height;
+    int size_p = width_p * height_p;
+    std::vector<int> rows = DCTdenoising_positions(height, height_p, step);
+    std::vector<int> cols = DCTdenoising_positions(width, width_p, step);
+    int num_rows_p = rows.size();
+    int num_stripes = (num_rows_p + STRIPE_HEIGHT - 1) / STRIPE_HEIGHT;
+    int stripe_rows = (STRIPE_HEIGHT - 1) * step + height_p;
+    DCTdenoising_transform transform(flag_dct16x16, DCT_kernel_best());
+
+    if (nthreads < 1)
+    {
+        nthreads = 1;
+    }
+    if (nthreads > num_stripes)
+    {
+        nthreads = num_stripes;
+    }
+
+    // clean the image
+    opixels.assign(size, 0.0);
+
+    // one buffer per stripe processed at the same time
+    std::vector<double> stripe_sum(nthreads * stripe_rows * width);
+
+    for (int wave = 0; wave < num_stripes; wave += nthreads)
+    {
+        int wave_end = std::min(wave + nthreads, num_stripes);
+
+        #pragma omp parallel num_threads(nthreads)
+        {
+            // scratch blocks holding the column transforms and the current patch
+            std::vector<double> colcoef(height_p * width);
+            std::vector<double> patch(size_p);
+            std::vector<double> tmp(size_p);
+
+            #pragma omp for schedule(static, 1)
+            for (int s = wave; s < wave_end; ++s)
+            {
+                double* buf = &stripe_sum[(s - wave) * stripe_rows * width];
+                std::fill(buf, buf + stripe_rows * width, 0.0);
+                int k_begin = s * STRIPE_HEIGHT;
+                int k_end = std::min(k_begin + STRIPE_HEIGHT, num_rows_p);
+                DCTdenoising_stripe(ipixels, buf, width, rows, k_begin, k_end, cols, width_p, height_p, Th, transform, &colcoef[0], &patch[0], &tmp[0]);
+            }
+        }
+
+        // merge the stripes in a fixed order
+        for (int s = wave; s < wave_end; ++s)
+        {
+            const double* buf = &stripe_sum[(s - wave) * stripe_rows * width];
+            int k_begin = s * STRIPE_HEIGHT;
+            int k_end = std::min(k_begin + STRIPE_HEIGHT, num_rows_p);
+            int j_begin = rows[k_begin];
+            int j_end = rows[k_end - 1] + height_p;
+            double* dst = &opixels[j_begin * width];
+            int n = (j_end - j_begin) * width;
+            for (int i = 0; i < n; ++i)
+            {
+                dst[i] += buf[i];
+            }
+        }
+    }
+
+    // Normalize by the weight
+    std::vector<double> weight_row = DCTdenoising_coverage(height, height_p, rows);
+    std::vector<double> weight_col = DCTdenoising_coverage(width, width_p, cols);
+    for (int j = 0; j < height; ++j)
+    {
+        for (int i = 0; i < width; ++i)
+        {
+            opixels[j * width + i] = opixels[j * width + i] / (weight_row[j] * weight_col[i]);
+        }
+    }
+}
+
+// Halve an image by averaging blocks of 2x2 pixels. The last row and column
+// of blocks of an image of odd size average the pixels they contain.
+void DCTdenoising_downsample(const std::vector<double>& in, int width, int height, std::vector<double>& out, int width_c, int height_c)
+{
+    out.assign(width_c * height_c, 0.0);
+    for (int j = 0; j < height; ++j)
+    {
+        const double* src = &in[j * width];
+        double* dst = &out[(j / 2) * width_c];
+        for (int i = 0; i < width; ++i)
+        {
+            dst[i / 2] += src[i];
+        }
+    }
+    for (int j = 0; j < height_c; ++j)
+    {
+        double nj = std::min(2, height - 2 * j);
+        for (int i = 0; i < width_c; ++i)
+        {
+            double ni = std::min(2, width - 2 * i);
+            out[j * width_c + i] /= ni * nj;
+        }
+    }
+}
+
+// Bilinear interpolation weights from a line of size_c pixels to a line of
+// size pixels, where the pixel k of the coarse line covers the pixels 2k and
+// 2k + 1 of the fine line.
+void DCTdenoising_upsample_weights(int size, int size_c, std::vector<int>& index0, std::vector<int>& index1, std::vector<double>& weight0)
+{
+    index0.resize(size);
+    index1.resize(size);
+    weight0.resize(size);
+    for (int x = 0; x < size; ++x)
+    {
+        int k = x / 2;
+        int neighbour = x % 2 == 0 ? k - 1 : k + 1;
+        index0[x] = k;
+        index1[x] = std::max(0, std::min(neighbour, size_c - 1));
+        weight0[x] = 0.75;
+    }
+}
+
+// Add the bilinear upsampling of in (width_c x height_c) to out (width x height).
+void DCTdenoising_upsample_add(const std::vector<double>& in, int width_c, int height_c, std::vector<double>& out, int width, int height)
+{
+    std::vector<int> col0, col1, row0, row1;
+    std::vector<double> wcol, wrow;
+    DCTdenoising_upsample_weights(width, width_c, col0, col1, wcol);
+    DCTdenoising_upsample_weights(height, height_c, row0, row1, wrow);
+
+    // upsample the rows, then interpolate between them
+    std::vector<double> rows_up(height_c * width);
+    for (int j = 0; j < height_c; ++j)
+    {
+        const double* src = &in[j * width_c];
+        double* dst = &rows_up[j * width];
+        for (int i = 0; i < width; ++i)
+        {
+            dst[i] = wcol[i] * src[col0[i]] + (1 - wcol[i]) * src[col1[i]];
+        }
+    }
+    for (int j = 0; j < height; ++j)
+    {
+        const double* src0 = &rows_up[row0[j] * width];
+        const double* src1 = &rows_up[row1[j] * width];
+        double* dst = &out[j * width];
+        for (int i = 0; i < width; ++i)
+        {
+            dst[i] += wrow[j] * src0[i] + (1 - wrow[j]) * src1[i];
+        }
+    }
+}
+
+// Multi-scale DCT denoising.
+// The image is denoised at full resolution with the threshold Th[level], and
+// the half-size image is denoised recursively with Th[level + 1]. The low 
+// frequencies of the full resolution result are then replaced by those of the
+// coarse result: opixels = fine - up(down(fine)) + up(coarse).
+// Low-frequency noise, which 8x8 or 16x16 patches cannot see, becomes high-frequency
+// noise at coarse scales. The coarse levels work on downsampled buffers, so 
+// the total cost is at most 4/3 of single-scale denoising.
+// Levels smaller than the patches are not used.
+void DCTdenoising_pyramid(const std::vector<double>& ipixels, std::vector<double>& opixels, int width, int height, int width_p, int height_p, const std::vector<double>& Th, int level, int flag_dct16x16, int step, int nthreads)
+{
+    DCTdenoising_stream(ipixels, opixels, width, height, width_p, height_p, Th[level], flag_dct16x16, step, nthreads);
+
+    int width_c = (width + 1) / 2;
+    int height_c = (height + 1) / 2;
+    if (level + 1 >= (int)Th.size() || width_c < width_p || height_c < height_p)
+    {
+        return;
+    }
+
+    std::vector<double> ipixels_c, opixels_c, fine_c;
+    DCTdenoising_downsample(ipixels, width, height, ipixels_c, width_c, height_c);
+    DCTdenoising_pyramid(ipixels_c, opixels_c, width_c, height_c, width_p, height_p, Th, level + 1, flag_dct16x16, step, nthreads);
+    DCTdenoising_downsample(opixels, width, height, fine_c, width_c, height_c);
+
+    // opixels += up(coarse - down(fine))
+    for (int i = 0; i < width_c * height_c; ++i)
+    {
+        opixels_c[i] -= fine_c[i];
+    }
+    DCTdenoising_upsample_add(opixels_c, width_c, height_c, opixels, width, height);
+}
 
 // Denoise an image with sliding DCT thresholding.
-// ipixels, opixels: noisy and denoised images.
-// width, height, channel: image width, height and number of channels.
-// sigma: standard deviation of Gaussian white noise in ipixels.
+// ipixelsR: noisy image.
+// width, height: image width and height.
+// sigma: standard deviation of the noise in ipixelsR at each scale, from the
+//        full resolution to the coarsest. The length of sigma is the number of
+//        scales (1 for single-scale denoising).
+// flag_dct16x16: 0/1 for 16x16/8x8 patches.
+// step: distance between neighbouring patches, from 1 to the patch size.
+// nthreads: number of threads.
 // [[Rcpp::export]]
-Rcpp::NumericMatrix DCTdenoising(Rcpp::NumericMatrix ipixelsR, int width, int height, double sigma, int flag_dct16x16)
+Rcpp::NumericMatrix DCTdenoising(Rcpp::NumericMatrix ipixelsR, int width, int height, Rcpp::NumericVector sigma, int flag_dct16x16, int step, int nthreads)
 {
     //Convert ipixelsR to std::vector<double>
     int size_ipixels = width * height;
@@ -643,8 +1040,12 @@ Rcpp::NumericMatrix DCTdenoising(Rcpp::NumericMatrix ipixelsR, int width, int he
         }
     }
 
-    // Threshold
-    double Th = 3 * sigma;
+    // Thresholds of the scales
+    std::vector<double> Th(sigma.size());
+    for (int l = 0; l < sigma.size(); ++l)
+    {
+        Th[l] = 3 * sigma[l];
+    }
 
     // DCT window size
     int width_p, height_p;
@@ -656,150 +1057,139 @@ Rcpp::NumericMatrix DCTdenoising(Rcpp::NumericMatrix ipixelsR, int width, int he
         height_p = 8;
     }
 
-    int num_patches = (width - width_p + 1) * (height - height_p + 1);
-    int channel = 1;
-
-    std::vector< std::vector< std::vector< std::vector< double > > > > patches;
-    patches.resize(num_patches);
-    for (int p = 0; p < num_patches; p ++) {
-        patches[p].resize(channel);
-        for (int k = 0; k < channel; k ++) {
-            patches[p][k].resize(height_p);
-            for (int j = 0; j < height_p; j ++)
-                patches[p][k][j].resize(width_p);
-        }
+    // sanity check for sigma, step, and the image size
+    if (sigma.size() < 1) {
+        Rcpp::Rcout << "Error: sigma is empty." << std::endl;
+        return Rcpp::NumericMatrix(height, width);
     }
-    Image2Patches(ipixels, patches, width, height, channel, width_p, height_p);
-
-    // 2D DCT forward
-    for (int p = 0; p < num_patches; p ++) {
-        for (int k = 0; k < channel; k ++) {
-            if (flag_dct16x16 == 0)
-                DCT2D16x16(patches[p][k], 1);
-            else
-                DCT2D(patches[p][k], 1);
-        }
+    if (step < 1 || step > width_p) {
+        Rcpp::Rcout << "Error: step must be in [1," << width_p << "]." << std::endl;
+        return Rcpp::NumericMatrix(height, width);
     }
-
-    // Thresholding
-    for (int p = 0; p < num_patches; p ++)
-        for (int k = 0; k < channel; k ++)
-            for (int j = 0; j < height_p; j ++)
-                for (int i = 0; i < width_p; i ++) {
-                    if ( ABS(patches[p][k][j][i]) < Th )
-                        patches[p][k][j][i] = 0;
-                }
-
-    // 2D DCT inverse
-    for (int p = 0; p < num_patches; p ++) {
-        for (int k = 0; k < channel; k ++) {
-            if (flag_dct16x16 == 0)
-            {
-                DCT2D16x16(patches[p][k], -1);
-            } else {
-                DCT2D(patches[p][k], -1);
-            }
-        }
+    if (width < width_p || height < height_p) {
+        Rcpp::Rcout << "Error: image is smaller than the patches." << std::endl;
+        return Rcpp::NumericMatrix(height, width);
     }
 
-    Patches2Image(ipixels, patches, width, height, channel, width_p, height_p);
+    std::vector<double> opixels;
+    DCTdenoising_pyramid(ipixels, opixels, width, height, width_p, height_p, Th, 0, flag_dct16x16, step, nthreads);
 
     Rcpp::NumericMatrix res(height, width);
     for(int i = 0; i < height; ++i)
     {
         for (int j = 0; j < width; ++j)
         {
-            res(i ,j) = ipixels[i * width + j];
+            res(i ,j) = opixels[i * width + j];
         }
     }
     return res;
 }
 
-// Transfer an image im of size width x height x channel to sliding patches of 
-// size width_p x height_p xchannel.
-// The patches are stored in patches, where each ROW is a patch after being 
-// reshaped to a vector.
-void Image2Patches(std::vector<double>& im, std::vector< std::vector< std::vector< std::vector< double > > > >& patches, int width, int height, int channel, int width_p, int height_p)
+// Reference check of the transforms of DCTdenoising_stream.
+// The transforms of every kernel supported by the running CPU and DCT1D_fast
+// are compared with DCT2D and DCT2D16x16 on random patches.
+// Returns the maximum absolute differences named after the kernels, followed
+// by one entry per kernel named "<kernel> same", which is 1 if the products of
+// the kernel are the same as those of the scalar kernel bit for bit on random
+// matrices of various sizes, 0 otherwise.
+// [[Rcpp::export]]
+Rcpp::NumericVector DCT_kernels_check(int n_patches)
 {
-    int size1 = width * height;
-    int counter_patch = 0;
+    DCT_kernel kernels[4];
+    int n_kernels = DCT_kernel_available(kernels, 4);
+    Rcpp::NumericVector res(2 * n_kernels + 1);
+    Rcpp::CharacterVector res_names(2 * n_kernels + 1);
+    int width = PATCHSIZE16 + 3;
 
-    // Loop over the patch positions
-    for (int j = 0; j < height - height_p + 1; ++j)
+    for (int l = 0; l <= n_kernels; ++l)
     {
-        for (int i = 0; i < width - width_p + 1; ++i) 
+        double maxdiff = 0.0;
+        for (int flag_dct16x16 = 0; flag_dct16x16 < 2; ++flag_dct16x16)
         {
-            int counter_pixel = 0;
-            // loop over the pixels in the patch
-            for (int kp = 0; kp < channel; ++kp)
+            // the last entry checks DCT1D_fast on 8x8 patches
+            if (l == n_kernels && flag_dct16x16 == 0)
+            {
+                continue;
+            }
+            const DCT_kernel& kernel = l < n_kernels ? kernels[l] : kernels[0];
+            DCTdenoising_transform transform(flag_dct16x16, kernel);
+            transform.flag_fast = l == n_kernels;
+            int n = transform.n;
+            std::vector<double> strip(n * width);
+            std::vector<double> colcoef(n * width);
+            std::vector<double> patch(n * n);
+            std::vector<double> tmp(n * n);
+            std::vector<double> ref(n * n);
+            for (int p = 0; p < n_patches; ++p)
             {
-                for (int jp = 0; jp < height_p; ++jp)
+                Rcpp::NumericVector randval = Rcpp::runif(n * width, 0, 255);
+                std::copy(randval.begin(), randval.end(), strip.begin());
+                int i = p % (width - n + 1);
+                transform.columns_strip(&strip[0], width, &colcoef[0]);
+                transform.rows_patch(&colcoef[0], width, i, &patch[0]);
+                for (int jp = 0; jp < n; ++jp)
                 {
-                    for (int ip = 0; ip < width_p; ++ip) 
+                    for (int ip = 0; ip < n; ++ip)
                     {
-                        patches[counter_patch][kp][jp][ip] = 
-                                         im[kp*size1 + (j+jp)*width + i + ip];
-                        ++counter_pixel;
+                        ref[jp * n + ip] = strip[jp * width + i + ip];
                     }
                 }
+                if (flag_dct16x16 == 0)
+                {
+                    DCT2D16x16(&ref[0], 1);
+                } else {
+                    DCT2D(&ref[0], 1);
+                }
+                for (int q = 0; q < n * n; ++q)
+                {
+                    maxdiff = std::max(maxdiff, ABS(patch[q] - ref[q]));
+                }
+                transform.inverse(&patch[0], &tmp[0]);
+                if (flag_dct16x16 == 0)
+                {
+                    DCT2D16x16(&ref[0], -1);
+                } else {
+                    DCT2D(&ref[0], -1);
+                }
+                for (int q = 0; q < n * n; ++q)
+                {
+                    maxdiff = std::max(maxdiff, ABS(patch[q] - ref[q]));
+                }
             }
-            ++counter_patch;
         }
-    }
-}
-
-// Transfer sliding patches of size width_p x height_p xchannel to an image im 
-// of size width x height x channel.
-// The patches are stored in patches, where each ROW is a patch after being 
-// reshaped to a vector.
-void Patches2Image(std::vector<double>& im, std::vector< std::vector< std::vector< std::vector< double > > > >& patches, int width, int height, int channel, int width_p, int height_p)
-{
-    int size1 = width * height;
-    int size = size1 * channel;
-
-    // clean the image
-    for (int i = 0; i < size; ++i)
-    {
-        im[i] = 0;
+        res[l] = maxdiff;
+        res_names[l] = l < n_kernels ? kernels[l].name : "fast8";
     }
 
-    // Store the weight
-    std::vector<double> im_weight;
-    im_weight.resize(size);
-    for (int i = 0; i < size; ++i)
+    // the sizes cover the full and the partial vectors of every kernel
+    const int sizes_m[3] = {1, 8, 20};
+    const int sizes_k[3] = {3, 8, 32};
+    const int sizes_n[7] = {1, 3, 8, 13, 32, 37, 64};
+    for (int l = 0; l < n_kernels; ++l)
     {
-        im_weight[i] = 0;
-      }
-
-    int counter_patch = 0;
-
-    // Loop over the patch positions
-    for (int j = 0; j < height - height_p + 1; ++j)
-    {
-        for (int i = 0; i < width - width_p + 1; ++i) 
+        bool same = true;
+        for (int im = 0; im < 3; ++im)
         {
-            int counter_pixel = 0;
-            // loop over the pixels in the patch
-            for (int kp = 0; kp < channel; ++kp)
+            for (int ik = 0; ik < 3; ++ik)
             {
-                for (int jp = 0; jp < height_p; ++jp)
+                for (int in = 0; in < 7; ++in)
                 {
-                    for (int ip = 0; ip < width_p; ++ip) 
-                    {
-                        im[kp*size1 + (j+jp)*width + i + ip] += 
-                                       patches[counter_patch][kp][jp][ip];
-                        ++im_weight[kp*size1 + (j+jp)*width + i + ip];
-                        ++counter_pixel;
-                    }
+                    int m = sizes_m[im];
+                    int k = sizes_k[ik];
+                    int n = sizes_n[in];
+                    Rcpp::NumericVector a = Rcpp::runif(m * k, -255, 255);
+                    Rcpp::NumericVector b = Rcpp::runif(k * n, -1, 1);
+                    std::vector<double> c(m * n);
+                    std::vector<double> c_scalar(m * n);
+                    kernels[l].matmul(a.begin(), k, b.begin(), n, &c[0], n, m, k, n);
+                    DCT_matmul_scalar(a.begin(), k, b.begin(), n, &c_scalar[0], n, m, k, n);
+                    same = same && std::memcmp(&c[0], &c_scalar[0], m * n * sizeof(double)) == 0;
                 }
             }
-            ++counter_patch;
         }
+        res[n_kernels + 1 + l] = same ? 1.0 : 0.0;
+        res_names[n_kernels + 1 + l] = std::string(kernels[l].name) + " same";
     }
-
-    // Normalize by the weight
-    for (int i = 0; i < size; ++i)
-    {
-        im[i] = im[i] / im_weight[i];
-    }
-}
\ No newline at end of file
+    res.attr("names") = res_names;
+    return res;
+}
@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2018, Shota Ochi <shotaochi1990@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//$ Matrix-form kernels of the DCT used in DCT denoising.
+//$ The SIMD kernels are compiled with target attributes and selected at run time,
+//$ so the package itself is built with the default compiler flags.
+
+#include "DCT_kernels.h"
+#include "fp_contract.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IMAGEREXTRA_DCT_X86 1
+#include <immintrin.h>
+#endif
+
+IMAGEREXTRA_NO_FP_CONTRACT
+void DCT_matmul_scalar(const double* a, int lda, const double* b, int ldb, double* c, int ldc, int m, int k, int n)
+{
+  for (int i = 0; i < m; ++i)
+  {
+    const double* ai = a + i * lda;
+    double* ci = c + i * ldc;
+    for (int j = 0; j < n; ++j)
+    {
+      ci[j] = 0;
+    }
+    for (int p = 0; p < k; ++p)
+    {
+      const double aip = ai[p];
+      const double* bp = b + p * ldb;
+      for (int j = 0; j < n; ++j)
+      {
+        ci[j] += bp[j] * aip;
+      }
+    }
+  }
+}
+
+#ifdef IMAGEREXTRA_DCT_X86
+
+__attribute__((target("sse2"))) IMAGEREXTRA_NO_FP_CONTRACT
+static void DCT_matmul_sse2(const double* a, int lda, const double* b, int ldb, double* c, int ldc, int m, int k, int n)
+{
+  for (int i = 0; i < m; ++i)
+  {
+    const double* ai = a + i * lda;
+    double* ci = c + i * ldc;
+    int j = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+      __m128d acc0 = _mm_setzero_pd();
+      __m128d acc1 = _mm_setzero_pd();
+      __m128d acc2 = _mm_setzero_pd();
+      __m128d acc3 = _mm_setzero_pd();
+      for (int p = 0; p < k; ++p)
+      {
+        const __m128d aip = _mm_set1_pd(ai[p]);
+        const double* bp = b + p * ldb + j;
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(bp), aip));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(bp + 2), aip));
+        acc2 = _mm_add_pd(acc2, _mm_mul_pd(_mm_loadu_pd(bp + 4), aip));
+        acc3 = _mm_add_pd(acc3, _mm_mul_pd(_mm_loadu_pd(bp + 6), aip));
+      }
+      _mm_storeu_pd(ci + j, acc0);
+      _mm_storeu_pd(ci + j + 2, acc1);
+      _mm_storeu_pd(ci + j + 4, acc2);
+      _mm_storeu_pd(ci + j + 6, acc3);
+    }
+    for (; j + 2 <= n; j += 2)
+    {
+      __m128d acc = _mm_setzero_pd();
+      for (int p = 0; p < k; ++p)
+      {
+        acc = _mm_add_pd(acc, _mm_mul_pd(_mm_loadu_pd(b + p * ldb + j), _mm_set1_pd(ai[p])));
+      }
+      _mm_storeu_pd(ci + j, acc);
+    }
+    for (; j < n; ++j)
+    {
+      double acc = 0;
+      for (int p = 0; p < k; ++p)
+      {
+        acc += b[p * ldb + j] * ai[p];
+      }
+      ci[j] = acc;
+    }
+  }
+}
+
+__attribute__((target("avx2"))) IMAGEREXTRA_NO_FP_CONTRACT
+static void DCT_matmul_avx2(const double* a, int lda, const double* b, int ldb, double* c, int ldc, int m, int k, int n)
+{
+  for (int i = 0; i < m; ++i)
+  {
+    const double* ai = a + i * lda;
+    double* ci = c + i * ldc;
+    int j = 0;
+    for (; j + 16 <= n; j += 16)
+    {
+      __m256d acc0 = _mm256_setzero_pd();
+      __m256d acc1 = _mm256_setzero_pd();
+      __m256d acc2 = _mm256_setzero_pd();
+      __m256d acc3 = _mm256_setzero_pd();
+      for (int p = 0; p < k; ++p)
+      {
+        const __m256d aip = _mm256_broadcast_sd(ai + p);
+        const double* bp = b + p * ldb + j;
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(_mm256_loadu_pd(bp), aip));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(_mm256_loadu_pd(bp + 4), aip));
+        acc2 = _mm256_add_pd(acc2, _mm256_mul_pd(_mm256_loadu_pd(bp + 8), aip));
+        acc3 = _mm256_add_pd(acc3, _mm256_mul_pd(_mm256_loadu_pd(bp + 12), aip));
+      }
+      _mm256_storeu_pd(ci + j, acc0);
+      _mm256_storeu_pd(ci + j + 4, acc1);
+      _mm256_storeu_pd(ci + j + 8, acc2);
+      _mm256_storeu_pd(ci + j + 12, acc3);
+    }
+    for (; j + 8 <= n; j += 8)
+    {
+      __m256d acc0 = _mm256_setzero_pd();
+      __m256d acc1 = _mm256_setzero_pd();
+      for (int p = 0; p < k; ++p)
+      {
+        const __m256d aip = _mm256_broadcast_sd(ai + p);
+        const double* bp = b + p * ldb + j;
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(_mm256_loadu_pd(bp), aip));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(_mm256_loadu_pd(bp + 4), aip));
+      }
+      _mm256_storeu_pd(ci + j, acc0);
+      _mm256_storeu_pd(ci + j + 4, acc1);
+    }
+    for (; j + 4 <= n; j += 4)
+    {
+      __m256d acc = _mm256_setzero_pd();
+      for (int p = 0; p < k; ++p)
+      {
+        acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_loadu_pd(b + p * ldb + j), _mm256_broadcast_sd(ai + p)));
+      }
+      _mm256_storeu_pd(ci + j, acc);
+    }
+    for (; j < n; ++j)
+    {
+      double acc = 0;
+      for (int p = 0; p < k; ++p)
+      {
+        acc += b[p * ldb + j] * ai[p];
+      }
+      ci[j] = acc;
+    }
+  }
+}
+
+__attribute__((target("avx512f"))) IMAGEREXTRA_NO_FP_CONTRACT
+static void DCT_matmul_avx512(const double* a, int lda, const double* b, int ldb, double* c, int ldc, int m, int k, int n)
+{
+  for (int i = 0; i < m; ++i)
+  {
+    const double* ai = a + i * lda;
+    double* ci = c + i * ldc;
+    int j = 0;
+    for (; j + 32 <= n; j += 32)
+    {
+      __m512d acc0 = _mm512_setzero_pd();
+      __m512d acc1 = _mm512_setzero_pd();
+      __m512d acc2 = _mm512_setzero_pd();
+      __m512d acc3 = _mm512_setzero_pd();
+      for (int p = 0; p < k; ++p)
+      {
+        const __m512d aip = _mm512_set1_pd(ai[p]);
+        const double* bp = b + p * ldb + j;
+        acc0 = _mm512_add_pd(acc0, _mm512_mul_pd(_mm512_loadu_pd(bp), aip));
+        acc1 = _mm512_add_pd(acc1, _mm512_mul_pd(_mm512_loadu_pd(bp + 8), aip));
+        acc2 = _mm512_add_pd(acc2, _mm512_mul_pd(_mm512_loadu_pd(bp + 16), aip));
+        acc3 = _mm512_add_pd(acc3, _mm512_mul_pd(_mm512_loadu_pd(bp + 24), aip));
+      }
+      _mm512_storeu_pd(ci + j, acc0);
+      _mm512_storeu_pd(ci + j + 8, acc1);
+      _mm512_storeu_pd(ci + j + 16, acc2);
+      _mm512_storeu_pd(ci + j + 24, acc3);
+    }
+    for (; j + 8 <= n; j += 8)
+    {
+      __m512d acc = _mm512_setzero_pd();
+      for (int p = 0; p < k; ++p)
+      {
+        acc = _mm512_add_pd(acc, _mm512_mul_pd(_mm512_loadu_pd(b + p * ldb + j), _mm512_set1_pd(ai[p])));
+      }
+      _mm512_storeu_pd(ci + j, acc);
+    }
+    if (j < n)
+    {
+      // the last block is loaded and stored with a mask
+      const __mmask8 mask = (__mmask8)((1u << (n - j)) - 1);
+      __m512d acc = _mm512_setzero_pd();
+      for (int p = 0; p < k; ++p)
+      {
+        acc = _mm512_add_pd(acc, _mm512_mul_pd(_mm512_maskz_loadu_pd(mask, b + p * ldb + j), _mm512_set1_pd(ai[p])));
+      }
+      _mm512_mask_storeu_pd(ci + j, mask, acc);
+    }
+  }
+}
+
+#endif
+
+int DCT_kernel_available(DCT_kernel* kernels, int maxnum)
+{
+  int count = 0;
+  if (count < maxnum)
+  {
+    kernels[count].name = "scalar";
+    kernels[count].width = 1;
+    kernels[count].matmul = DCT_matmul_scalar;
+    ++count;
+  }
+#ifdef IMAGEREXTRA_DCT_X86
+  __builtin_cpu_init();
+  if (count < maxnum && __builtin_cpu_supports("sse2"))
+  {
+    kernels[count].name = "sse2";
+    kernels[count].width = 2;
+    kernels[count].matmul = DCT_matmul_sse2;
+    ++count;
+  }
+  if (count < maxnum && __builtin_cpu_supports("avx2"))
+  {
+    kernels[count].name = "avx2";
+    kernels[count].width = 4;
+    kernels[count].matmul = DCT_matmul_avx2;
+    ++count;
+  }
+  if (count < maxnum && __builtin_cpu_supports("avx512f"))
+  {
+    kernels[count].name = "avx512";
+    kernels[count].width = 8;
+    kernels[count].matmul = DCT_matmul_avx512;
+    ++count;
+  }
+#endif
+  return count;
+}
+
+static DCT_kernel DCT_kernel_select()
+{
+  DCT_kernel kernels[4];
+  int count = DCT_kernel_available(kernels, 4);
+  return kernels[count - 1];
+}
+
+const DCT_kernel& DCT_kernel_best()
+{
+  static const DCT_kernel best = DCT_kernel_select();
+  return best;
+}
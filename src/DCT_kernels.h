@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2018, Shota Ochi <shotaochi1990@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGEREXTRA_DCT_KERNELS_H
+#define IMAGEREXTRA_DCT_KERNELS_H
+
+// c = a * b where a, b, and c are row-major matrices of size m x k, k x n,
+// and m x n. lda, ldb, and ldc are the distances between consecutive rows.
+// Every element of c is accumulated in ascending order of k and without fused
+// multiply-add, so all the kernels return the same result as the scalar one.
+typedef void (*DCT_matmul_kernel)(const double* a, int lda, const double* b, int ldb, double* c, int ldc, int m, int k, int n);
+
+struct DCT_kernel
+{
+  const char* name;
+  int width; // number of doubles processed by one instruction
+  DCT_matmul_kernel matmul;
+};
+
+// scalar kernel, available on every platform
+void DCT_matmul_scalar(const double* a, int lda, const double* b, int ldb, double* c, int ldc, int m, int k, int n);
+
+// fastest kernel supported by the running CPU (SSE2, AVX2, AVX-512, or scalar)
+const DCT_kernel& DCT_kernel_best();
+
+// all the kernels supported by the running CPU, the scalar one first
+int DCT_kernel_available(DCT_kernel* kernels, int maxnum);
+
+#endif
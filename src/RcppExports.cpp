@@ -11,29 +11,30 @@ Rcpp::Rostream<false>& Rcpp::Rcerr = Rcpp::Rcpp_cerr_get();
 #endif
 
 // DCTdenoising
-Rcpp::NumericMatrix DCTdenoising(Rcpp::NumericMatrix ipixelsR, int width, int height, double sigma, int flag_dct16x16);
-RcppExport SEXP _imagerExtra_DCTdenoising(SEXP ipixelsRSEXP, SEXP widthSEXP, SEXP heightSEXP, SEXP sigmaSEXP, SEXP flag_dct16x16SEXP) {
+Rcpp::NumericMatrix DCTdenoising(Rcpp::NumericMatrix ipixelsR, int width, int height, Rcpp::NumericVector sigma, int flag_dct16x16, int step, int nthreads);
+RcppExport SEXP _imagerExtra_DCTdenoising(SEXP ipixelsRSEXP, SEXP widthSEXP, SEXP heightSEXP, SEXP sigmaSEXP, SEXP flag_dct16x16SEXP, SEXP stepSEXP, SEXP nthreadsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< Rcpp::NumericMatrix >::type ipixelsR(ipixelsRSEXP);
     Rcpp::traits::input_parameter< int >::type width(widthSEXP);
     Rcpp::traits::input_parameter< int >::type height(heightSEXP);
-    Rcpp::traits::input_parameter< double >::type sigma(sigmaSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type sigma(sigmaSEXP);
     Rcpp::traits::input_parameter< int >::type flag_dct16x16(flag_dct16x16SEXP);
-    rcpp_result_gen = Rcpp::wrap(DCTdenoising(ipixelsR, width, height, sigma, flag_dct16x16));
+    Rcpp::traits::input_parameter< int >::type step(stepSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(DCTdenoising(ipixelsR, width, height, sigma, flag_dct16x16, step, nthreads));
     return rcpp_result_gen;
 END_RCPP
 }
-// make_histogram_ADPHE
-Rcpp::NumericVector make_histogram_ADPHE(const Rcpp::NumericVector& ordered, const Rcpp::NumericVector& interval);
-RcppExport SEXP _imagerExtra_make_histogram_ADPHE(SEXP orderedSEXP, SEXP intervalSEXP) {
+// DCT_kernels_check
+Rcpp::NumericVector DCT_kernels_check(int n_patches);
+RcppExport SEXP _imagerExtra_DCT_kernels_check(SEXP n_patchesSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type ordered(orderedSEXP);
-    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type interval(intervalSEXP);
-    rcpp_result_gen = Rcpp::wrap(make_histogram_ADPHE(ordered, interval));
+    Rcpp::traits::input_parameter< int >::type n_patches(n_patchesSEXP);
+    rcpp_result_gen = Rcpp::wrap(DCT_kernels_check(n_patches));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -121,65 +122,61 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
-// DCT2D_reorder
-Rcpp::NumericMatrix DCT2D_reorder(Rcpp::NumericMatrix mat);
-RcppExport SEXP _imagerExtra_DCT2D_reorder(SEXP matSEXP) {
+// DCT2D_cache_prewarm
+void DCT2D_cache_prewarm(Rcpp::IntegerVector nrow, Rcpp::IntegerVector ncol);
+RcppExport SEXP _imagerExtra_DCT2D_cache_prewarm(SEXP nrowSEXP, SEXP ncolSEXP) {
 BEGIN_RCPP
-    Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< Rcpp::NumericMatrix >::type mat(matSEXP);
-    rcpp_result_gen = Rcpp::wrap(DCT2D_reorder(mat));
-    return rcpp_result_gen;
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type nrow(nrowSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type ncol(ncolSEXP);
+    DCT2D_cache_prewarm(nrow, ncol);
+    return R_NilValue;
 END_RCPP
 }
-// DCT2D_fromDFT
-Rcpp::NumericMatrix DCT2D_fromDFT(Rcpp::ComplexMatrix mat);
-RcppExport SEXP _imagerExtra_DCT2D_fromDFT(SEXP matSEXP) {
+// DCT2D_cache_clear
+void DCT2D_cache_clear();
+RcppExport SEXP _imagerExtra_DCT2D_cache_clear() {
 BEGIN_RCPP
-    Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< Rcpp::ComplexMatrix >::type mat(matSEXP);
-    rcpp_result_gen = Rcpp::wrap(DCT2D_fromDFT(mat));
-    return rcpp_result_gen;
+    DCT2D_cache_clear();
+    return R_NilValue;
 END_RCPP
 }
-// IDCT2D_toDFT
-Rcpp::ComplexMatrix IDCT2D_toDFT(Rcpp::NumericMatrix mat);
-RcppExport SEXP _imagerExtra_IDCT2D_toDFT(SEXP matSEXP) {
+// DCT2D_cache_stats
+Rcpp::IntegerVector DCT2D_cache_stats();
+RcppExport SEXP _imagerExtra_DCT2D_cache_stats() {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< Rcpp::NumericMatrix >::type mat(matSEXP);
-    rcpp_result_gen = Rcpp::wrap(IDCT2D_toDFT(mat));
+    rcpp_result_gen = Rcpp::wrap(DCT2D_cache_stats());
     return rcpp_result_gen;
 END_RCPP
 }
-// IDCT2D_retrievex
-Rcpp::NumericMatrix IDCT2D_retrievex(Rcpp::NumericMatrix mat);
-RcppExport SEXP _imagerExtra_IDCT2D_retrievex(SEXP matSEXP) {
+// DCT2D_fft
+Rcpp::NumericMatrix DCT2D_fft(Rcpp::NumericMatrix mat);
+RcppExport SEXP _imagerExtra_DCT2D_fft(SEXP matSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< Rcpp::NumericMatrix >::type mat(matSEXP);
-    rcpp_result_gen = Rcpp::wrap(IDCT2D_retrievex(mat));
+    rcpp_result_gen = Rcpp::wrap(DCT2D_fft(mat));
     return rcpp_result_gen;
 END_RCPP
 }
-// make_histogram_fuzzy
-Rcpp::NumericVector make_histogram_fuzzy(Rcpp::NumericVector ordered, Rcpp::NumericVector interval);
-RcppExport SEXP _imagerExtra_make_histogram_fuzzy(SEXP orderedSEXP, SEXP intervalSEXP) {
+// IDCT2D_fft
+Rcpp::NumericMatrix IDCT2D_fft(Rcpp::NumericMatrix mat);
+RcppExport SEXP _imagerExtra_IDCT2D_fft(SEXP matSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type ordered(orderedSEXP);
-    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type interval(intervalSEXP);
-    rcpp_result_gen = Rcpp::wrap(make_histogram_fuzzy(ordered, interval));
+    Rcpp::traits::input_parameter< Rcpp::NumericMatrix >::type mat(matSEXP);
+    rcpp_result_gen = Rcpp::wrap(IDCT2D_fft(mat));
     return rcpp_result_gen;
 END_RCPP
 }
 // fuzzy_threshold
-double fuzzy_threshold(Rcpp::NumericVector imhist, Rcpp::NumericVector interval, int n, int maxiter, double omegamax, double omegamin, double c1, double c2, double mutrate, double vmax, int localsearch);
-RcppExport SEXP _imagerExtra_fuzzy_threshold(SEXP imhistSEXP, SEXP intervalSEXP, SEXP nSEXP, SEXP maxiterSEXP, SEXP omegamaxSEXP, SEXP omegaminSEXP, SEXP c1SEXP, SEXP c2SEXP, SEXP mutrateSEXP, SEXP vmaxSEXP, SEXP localsearchSEXP) {
+double fuzzy_threshold(Rcpp::NumericVector imhist, Rcpp::NumericVector interval, int n, int maxiter, double omegamax, double omegamin, double c1, double c2, double mutrate, double vmax, int localsearch, int nruns, double seed, int nthreads);
+RcppExport SEXP _imagerExtra_fuzzy_threshold(SEXP imhistSEXP, SEXP intervalSEXP, SEXP nSEXP, SEXP maxiterSEXP, SEXP omegamaxSEXP, SEXP omegaminSEXP, SEXP c1SEXP, SEXP c2SEXP, SEXP mutrateSEXP, SEXP vmaxSEXP, SEXP localsearchSEXP, SEXP nrunsSEXP, SEXP seedSEXP, SEXP nthreadsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -194,22 +191,35 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< double >::type mutrate(mutrateSEXP);
     Rcpp::traits::input_parameter< double >::type vmax(vmaxSEXP);
     Rcpp::traits::input_parameter< int >::type localsearch(localsearchSEXP);
-    rcpp_result_gen = Rcpp::wrap(fuzzy_threshold(imhist, interval, n, maxiter, omegamax, omegamin, c1, c2, mutrate, vmax, localsearch));
+    Rcpp::traits::input_parameter< int >::type nruns(nrunsSEXP);
+    Rcpp::traits::input_parameter< double >::type seed(seedSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(fuzzy_threshold(imhist, interval, n, maxiter, omegamax, omegamin, c1, c2, mutrate, vmax, localsearch, nruns, seed, nthreads));
     return rcpp_result_gen;
 END_RCPP
 }
-// make_prob_otsu
-Rcpp::NumericVector make_prob_otsu(Rcpp::NumericVector ordered, Rcpp::NumericVector bins, int intervalnumber, int width, int height);
-RcppExport SEXP _imagerExtra_make_prob_otsu(SEXP orderedSEXP, SEXP binsSEXP, SEXP intervalnumberSEXP, SEXP widthSEXP, SEXP heightSEXP) {
+// fuzzy_threshold_exact
+double fuzzy_threshold_exact(Rcpp::NumericVector imhist, Rcpp::NumericVector interval);
+RcppExport SEXP _imagerExtra_fuzzy_threshold_exact(SEXP imhistSEXP, SEXP intervalSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type ordered(orderedSEXP);
-    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type bins(binsSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type imhist(imhistSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type interval(intervalSEXP);
+    rcpp_result_gen = Rcpp::wrap(fuzzy_threshold_exact(imhist, interval));
+    return rcpp_result_gen;
+END_RCPP
+}
+// make_histogram
+Rcpp::List make_histogram(Rcpp::NumericVector data, int intervalnumber, int nthreads);
+RcppExport SEXP _imagerExtra_make_histogram(SEXP dataSEXP, SEXP intervalnumberSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type data(dataSEXP);
     Rcpp::traits::input_parameter< int >::type intervalnumber(intervalnumberSEXP);
-    Rcpp::traits::input_parameter< int >::type width(widthSEXP);
-    Rcpp::traits::input_parameter< int >::type height(heightSEXP);
-    rcpp_result_gen = Rcpp::wrap(make_prob_otsu(ordered, bins, intervalnumber, width, height));
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(make_histogram(data, intervalnumber, nthreads));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -225,9 +235,48 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// threshold_triclass
+Rcpp::List threshold_triclass(Rcpp::NumericVector prob_otsu, Rcpp::NumericVector bins, double stopval, int repeatnum);
+RcppExport SEXP _imagerExtra_threshold_triclass(SEXP prob_otsuSEXP, SEXP binsSEXP, SEXP stopvalSEXP, SEXP repeatnumSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type prob_otsu(prob_otsuSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type bins(binsSEXP);
+    Rcpp::traits::input_parameter< double >::type stopval(stopvalSEXP);
+    Rcpp::traits::input_parameter< int >::type repeatnum(repeatnumSEXP);
+    rcpp_result_gen = Rcpp::wrap(threshold_triclass(prob_otsu, bins, stopval, repeatnum));
+    return rcpp_result_gen;
+END_RCPP
+}
+// otsu_stats
+Rcpp::List otsu_stats(Rcpp::NumericVector prob_otsu, Rcpp::NumericVector bins);
+RcppExport SEXP _imagerExtra_otsu_stats(SEXP prob_otsuSEXP, SEXP binsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type prob_otsu(prob_otsuSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type bins(binsSEXP);
+    rcpp_result_gen = Rcpp::wrap(otsu_stats(prob_otsu, bins));
+    return rcpp_result_gen;
+END_RCPP
+}
+// otsu_multilevel
+Rcpp::List otsu_multilevel(Rcpp::NumericVector prob_otsu, Rcpp::NumericVector bins, int n_thres);
+RcppExport SEXP _imagerExtra_otsu_multilevel(SEXP prob_otsuSEXP, SEXP binsSEXP, SEXP n_thresSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type prob_otsu(prob_otsuSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type bins(binsSEXP);
+    Rcpp::traits::input_parameter< int >::type n_thres(n_thresSEXP);
+    rcpp_result_gen = Rcpp::wrap(otsu_multilevel(prob_otsu, bins, n_thres));
+    return rcpp_result_gen;
+END_RCPP
+}
 // threshold_adaptive
-Rcpp::NumericMatrix threshold_adaptive(Rcpp::NumericMatrix mat, double k, int windowsize, double maxsd);
-RcppExport SEXP _imagerExtra_threshold_adaptive(SEXP matSEXP, SEXP kSEXP, SEXP windowsizeSEXP, SEXP maxsdSEXP) {
+Rcpp::NumericMatrix threshold_adaptive(Rcpp::NumericMatrix mat, double k, int windowsize, double maxsd, int nthreads);
+RcppExport SEXP _imagerExtra_threshold_adaptive(SEXP matSEXP, SEXP kSEXP, SEXP windowsizeSEXP, SEXP maxsdSEXP, SEXP nthreadsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -235,19 +284,76 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< double >::type k(kSEXP);
     Rcpp::traits::input_parameter< int >::type windowsize(windowsizeSEXP);
     Rcpp::traits::input_parameter< double >::type maxsd(maxsdSEXP);
-    rcpp_result_gen = Rcpp::wrap(threshold_adaptive(mat, k, windowsize, maxsd));
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(threshold_adaptive(mat, k, windowsize, maxsd, nthreads));
     return rcpp_result_gen;
 END_RCPP
 }
-// make_density_multilevel
-Rcpp::NumericVector make_density_multilevel(Rcpp::NumericVector ordered, Rcpp::NumericVector interval);
-RcppExport SEXP _imagerExtra_make_density_multilevel(SEXP orderedSEXP, SEXP intervalSEXP) {
+// threshold_adaptive_multi
+Rcpp::List threshold_adaptive_multi(Rcpp::NumericMatrix mat, Rcpp::NumericVector k, Rcpp::IntegerVector windowsize, double maxsd, bool votes, int nthreads);
+RcppExport SEXP _imagerExtra_threshold_adaptive_multi(SEXP matSEXP, SEXP kSEXP, SEXP windowsizeSEXP, SEXP maxsdSEXP, SEXP votesSEXP, SEXP nthreadsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type ordered(orderedSEXP);
-    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type interval(intervalSEXP);
-    rcpp_result_gen = Rcpp::wrap(make_density_multilevel(ordered, interval));
+    Rcpp::traits::input_parameter< Rcpp::NumericMatrix >::type mat(matSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type k(kSEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type windowsize(windowsizeSEXP);
+    Rcpp::traits::input_parameter< double >::type maxsd(maxsdSEXP);
+    Rcpp::traits::input_parameter< bool >::type votes(votesSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(threshold_adaptive_multi(mat, k, windowsize, maxsd, votes, nthreads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// threshold_adaptive_robust
+Rcpp::NumericMatrix threshold_adaptive_robust(Rcpp::NumericMatrix mat, double k, int windowsize, double maxsd, int nthreads);
+RcppExport SEXP _imagerExtra_threshold_adaptive_robust(SEXP matSEXP, SEXP kSEXP, SEXP windowsizeSEXP, SEXP maxsdSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::NumericMatrix >::type mat(matSEXP);
+    Rcpp::traits::input_parameter< double >::type k(kSEXP);
+    Rcpp::traits::input_parameter< int >::type windowsize(windowsizeSEXP);
+    Rcpp::traits::input_parameter< double >::type maxsd(maxsdSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(threshold_adaptive_robust(mat, k, windowsize, maxsd, nthreads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// adaptive_stream_new
+SEXP adaptive_stream_new(int width, double k, int windowsize, double maxsd);
+RcppExport SEXP _imagerExtra_adaptive_stream_new(SEXP widthSEXP, SEXP kSEXP, SEXP windowsizeSEXP, SEXP maxsdSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< int >::type width(widthSEXP);
+    Rcpp::traits::input_parameter< double >::type k(kSEXP);
+    Rcpp::traits::input_parameter< int >::type windowsize(windowsizeSEXP);
+    Rcpp::traits::input_parameter< double >::type maxsd(maxsdSEXP);
+    rcpp_result_gen = Rcpp::wrap(adaptive_stream_new(width, k, windowsize, maxsd));
+    return rcpp_result_gen;
+END_RCPP
+}
+// adaptive_stream_push
+Rcpp::NumericMatrix adaptive_stream_push(SEXP stream, Rcpp::NumericVector lines);
+RcppExport SEXP _imagerExtra_adaptive_stream_push(SEXP streamSEXP, SEXP linesSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type stream(streamSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type lines(linesSEXP);
+    rcpp_result_gen = Rcpp::wrap(adaptive_stream_push(stream, lines));
+    return rcpp_result_gen;
+END_RCPP
+}
+// adaptive_stream_finish
+Rcpp::NumericMatrix adaptive_stream_finish(SEXP stream);
+RcppExport SEXP _imagerExtra_adaptive_stream_finish(SEXP streamSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type stream(streamSEXP);
+    rcpp_result_gen = Rcpp::wrap(adaptive_stream_finish(stream));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -262,9 +368,22 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// get_threshold_multilevel_exact
+Rcpp::IntegerVector get_threshold_multilevel_exact(Rcpp::NumericVector im_density, Rcpp::NumericVector im_integral_density, int n_thres);
+RcppExport SEXP _imagerExtra_get_threshold_multilevel_exact(SEXP im_densitySEXP, SEXP im_integral_densitySEXP, SEXP n_thresSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type im_density(im_densitySEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type im_integral_density(im_integral_densitySEXP);
+    Rcpp::traits::input_parameter< int >::type n_thres(n_thresSEXP);
+    rcpp_result_gen = Rcpp::wrap(get_threshold_multilevel_exact(im_density, im_integral_density, n_thres));
+    return rcpp_result_gen;
+END_RCPP
+}
 // get_threshold_multilevel
-Rcpp::IntegerVector get_threshold_multilevel(Rcpp::NumericVector im_density, Rcpp::NumericVector im_integral_density, int n_thres, int sn, int mcn, int limit);
-RcppExport SEXP _imagerExtra_get_threshold_multilevel(SEXP im_densitySEXP, SEXP im_integral_densitySEXP, SEXP n_thresSEXP, SEXP snSEXP, SEXP mcnSEXP, SEXP limitSEXP) {
+Rcpp::IntegerVector get_threshold_multilevel(Rcpp::NumericVector im_density, Rcpp::NumericVector im_integral_density, int n_thres, int sn, int mcn, int limit, int nruns, double seed, int nthreads);
+RcppExport SEXP _imagerExtra_get_threshold_multilevel(SEXP im_densitySEXP, SEXP im_integral_densitySEXP, SEXP n_thresSEXP, SEXP snSEXP, SEXP mcnSEXP, SEXP limitSEXP, SEXP nrunsSEXP, SEXP seedSEXP, SEXP nthreadsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -274,7 +393,10 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< int >::type sn(snSEXP);
     Rcpp::traits::input_parameter< int >::type mcn(mcnSEXP);
     Rcpp::traits::input_parameter< int >::type limit(limitSEXP);
-    rcpp_result_gen = Rcpp::wrap(get_threshold_multilevel(im_density, im_integral_density, n_thres, sn, mcn, limit));
+    Rcpp::traits::input_parameter< int >::type nruns(nrunsSEXP);
+    Rcpp::traits::input_parameter< double >::type seed(seedSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(get_threshold_multilevel(im_density, im_integral_density, n_thres, sn, mcn, limit, nruns, seed, nthreads));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -290,6 +412,29 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// entropy_kernels_check
+Rcpp::NumericVector entropy_kernels_check(int n);
+RcppExport SEXP _imagerExtra_entropy_kernels_check(SEXP nSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< int >::type n(nSEXP);
+    rcpp_result_gen = Rcpp::wrap(entropy_kernels_check(n));
+    return rcpp_result_gen;
+END_RCPP
+}
+// objective_benchmark
+Rcpp::List objective_benchmark(int n_bins, int n_reps);
+RcppExport SEXP _imagerExtra_objective_benchmark(SEXP n_binsSEXP, SEXP n_repsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< int >::type n_bins(n_binsSEXP);
+    Rcpp::traits::input_parameter< int >::type n_reps(n_repsSEXP);
+    rcpp_result_gen = Rcpp::wrap(objective_benchmark(n_bins, n_reps));
+    return rcpp_result_gen;
+END_RCPP
+}
 // piecewise_transformation
 Rcpp::NumericVector piecewise_transformation(Rcpp::NumericVector data, Rcpp::NumericVector F, int N, double smax, double smin, double max, double min, double max_range, double min_range);
 RcppExport SEXP _imagerExtra_piecewise_transformation(SEXP dataSEXP, SEXP FSEXP, SEXP NSEXP, SEXP smaxSEXP, SEXP sminSEXP, SEXP maxSEXP, SEXP minSEXP, SEXP max_rangeSEXP, SEXP min_rangeSEXP) {
@@ -309,59 +454,73 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
-// screened_poisson_dct
-Rcpp::NumericMatrix screened_poisson_dct(Rcpp::NumericMatrix data, double L);
-RcppExport SEXP _imagerExtra_screened_poisson_dct(SEXP dataSEXP, SEXP LSEXP) {
+// screened_poisson_equation
+Rcpp::List screened_poisson_equation(Rcpp::NumericMatrix im, Rcpp::NumericVector L, double s, double max_range, double min_range);
+RcppExport SEXP _imagerExtra_screened_poisson_equation(SEXP imSEXP, SEXP LSEXP, SEXP sSEXP, SEXP max_rangeSEXP, SEXP min_rangeSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< Rcpp::NumericMatrix >::type data(dataSEXP);
-    Rcpp::traits::input_parameter< double >::type L(LSEXP);
-    rcpp_result_gen = Rcpp::wrap(screened_poisson_dct(data, L));
+    Rcpp::traits::input_parameter< Rcpp::NumericMatrix >::type im(imSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type L(LSEXP);
+    Rcpp::traits::input_parameter< double >::type s(sSEXP);
+    Rcpp::traits::input_parameter< double >::type max_range(max_rangeSEXP);
+    Rcpp::traits::input_parameter< double >::type min_range(min_rangeSEXP);
+    rcpp_result_gen = Rcpp::wrap(screened_poisson_equation(im, L, s, max_range, min_range));
     return rcpp_result_gen;
 END_RCPP
 }
-// saturateim
-Rcpp::NumericVector saturateim(Rcpp::NumericVector data, double max_im, double min_im, double max_range, double min_range);
-RcppExport SEXP _imagerExtra_saturateim(SEXP dataSEXP, SEXP max_imSEXP, SEXP min_imSEXP, SEXP max_rangeSEXP, SEXP min_rangeSEXP) {
+// balance_simplest
+Rcpp::NumericVector balance_simplest(Rcpp::NumericVector data, double sleft, double sright, double max_range, double min_range);
+RcppExport SEXP _imagerExtra_balance_simplest(SEXP dataSEXP, SEXP sleftSEXP, SEXP srightSEXP, SEXP max_rangeSEXP, SEXP min_rangeSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< Rcpp::NumericVector >::type data(dataSEXP);
-    Rcpp::traits::input_parameter< double >::type max_im(max_imSEXP);
-    Rcpp::traits::input_parameter< double >::type min_im(min_imSEXP);
+    Rcpp::traits::input_parameter< double >::type sleft(sleftSEXP);
+    Rcpp::traits::input_parameter< double >::type sright(srightSEXP);
     Rcpp::traits::input_parameter< double >::type max_range(max_rangeSEXP);
     Rcpp::traits::input_parameter< double >::type min_range(min_rangeSEXP);
-    rcpp_result_gen = Rcpp::wrap(saturateim(data, max_im, min_im, max_range, min_range));
+    rcpp_result_gen = Rcpp::wrap(balance_simplest(data, sleft, sright, max_range, min_range));
     return rcpp_result_gen;
 END_RCPP
 }
 
 static const R_CallMethodDef CallEntries[] = {
-    {"_imagerExtra_DCTdenoising", (DL_FUNC) &_imagerExtra_DCTdenoising, 5},
-    {"_imagerExtra_make_histogram_ADPHE", (DL_FUNC) &_imagerExtra_make_histogram_ADPHE, 2},
+    {"_imagerExtra_DCTdenoising", (DL_FUNC) &_imagerExtra_DCTdenoising, 7},
+    {"_imagerExtra_DCT_kernels_check", (DL_FUNC) &_imagerExtra_DCT_kernels_check, 1},
     {"_imagerExtra_find_local_maximum_ADPHE", (DL_FUNC) &_imagerExtra_find_local_maximum_ADPHE, 2},
     {"_imagerExtra_modify_histogram_ADPHE", (DL_FUNC) &_imagerExtra_modify_histogram_ADPHE, 3},
     {"_imagerExtra_histogram_equalization_ADPHE", (DL_FUNC) &_imagerExtra_histogram_equalization_ADPHE, 5},
     {"_imagerExtra_ChanVeseInitPhi", (DL_FUNC) &_imagerExtra_ChanVeseInitPhi, 2},
     {"_imagerExtra_ChanVeseInitPhi_Rect", (DL_FUNC) &_imagerExtra_ChanVeseInitPhi_Rect, 3},
     {"_imagerExtra_ChanVese", (DL_FUNC) &_imagerExtra_ChanVese, 9},
-    {"_imagerExtra_DCT2D_reorder", (DL_FUNC) &_imagerExtra_DCT2D_reorder, 1},
-    {"_imagerExtra_DCT2D_fromDFT", (DL_FUNC) &_imagerExtra_DCT2D_fromDFT, 1},
-    {"_imagerExtra_IDCT2D_toDFT", (DL_FUNC) &_imagerExtra_IDCT2D_toDFT, 1},
-    {"_imagerExtra_IDCT2D_retrievex", (DL_FUNC) &_imagerExtra_IDCT2D_retrievex, 1},
-    {"_imagerExtra_make_histogram_fuzzy", (DL_FUNC) &_imagerExtra_make_histogram_fuzzy, 2},
-    {"_imagerExtra_fuzzy_threshold", (DL_FUNC) &_imagerExtra_fuzzy_threshold, 11},
-    {"_imagerExtra_make_prob_otsu", (DL_FUNC) &_imagerExtra_make_prob_otsu, 5},
+    {"_imagerExtra_DCT2D_cache_prewarm", (DL_FUNC) &_imagerExtra_DCT2D_cache_prewarm, 2},
+    {"_imagerExtra_DCT2D_cache_clear", (DL_FUNC) &_imagerExtra_DCT2D_cache_clear, 0},
+    {"_imagerExtra_DCT2D_cache_stats", (DL_FUNC) &_imagerExtra_DCT2D_cache_stats, 0},
+    {"_imagerExtra_DCT2D_fft", (DL_FUNC) &_imagerExtra_DCT2D_fft, 1},
+    {"_imagerExtra_IDCT2D_fft", (DL_FUNC) &_imagerExtra_IDCT2D_fft, 1},
+    {"_imagerExtra_fuzzy_threshold", (DL_FUNC) &_imagerExtra_fuzzy_threshold, 14},
+    {"_imagerExtra_fuzzy_threshold_exact", (DL_FUNC) &_imagerExtra_fuzzy_threshold_exact, 2},
+    {"_imagerExtra_make_histogram", (DL_FUNC) &_imagerExtra_make_histogram, 3},
     {"_imagerExtra_get_th_otsu", (DL_FUNC) &_imagerExtra_get_th_otsu, 2},
-    {"_imagerExtra_threshold_adaptive", (DL_FUNC) &_imagerExtra_threshold_adaptive, 4},
-    {"_imagerExtra_make_density_multilevel", (DL_FUNC) &_imagerExtra_make_density_multilevel, 2},
+    {"_imagerExtra_threshold_triclass", (DL_FUNC) &_imagerExtra_threshold_triclass, 4},
+    {"_imagerExtra_otsu_stats", (DL_FUNC) &_imagerExtra_otsu_stats, 2},
+    {"_imagerExtra_otsu_multilevel", (DL_FUNC) &_imagerExtra_otsu_multilevel, 3},
+    {"_imagerExtra_threshold_adaptive", (DL_FUNC) &_imagerExtra_threshold_adaptive, 5},
+    {"_imagerExtra_threshold_adaptive_multi", (DL_FUNC) &_imagerExtra_threshold_adaptive_multi, 6},
+    {"_imagerExtra_threshold_adaptive_robust", (DL_FUNC) &_imagerExtra_threshold_adaptive_robust, 5},
+    {"_imagerExtra_adaptive_stream_new", (DL_FUNC) &_imagerExtra_adaptive_stream_new, 4},
+    {"_imagerExtra_adaptive_stream_push", (DL_FUNC) &_imagerExtra_adaptive_stream_push, 2},
+    {"_imagerExtra_adaptive_stream_finish", (DL_FUNC) &_imagerExtra_adaptive_stream_finish, 1},
     {"_imagerExtra_make_integral_density_multilevel", (DL_FUNC) &_imagerExtra_make_integral_density_multilevel, 1},
-    {"_imagerExtra_get_threshold_multilevel", (DL_FUNC) &_imagerExtra_get_threshold_multilevel, 6},
+    {"_imagerExtra_get_threshold_multilevel_exact", (DL_FUNC) &_imagerExtra_get_threshold_multilevel_exact, 3},
+    {"_imagerExtra_get_threshold_multilevel", (DL_FUNC) &_imagerExtra_get_threshold_multilevel, 9},
     {"_imagerExtra_threshold_multilevel", (DL_FUNC) &_imagerExtra_threshold_multilevel, 2},
+    {"_imagerExtra_entropy_kernels_check", (DL_FUNC) &_imagerExtra_entropy_kernels_check, 1},
+    {"_imagerExtra_objective_benchmark", (DL_FUNC) &_imagerExtra_objective_benchmark, 2},
     {"_imagerExtra_piecewise_transformation", (DL_FUNC) &_imagerExtra_piecewise_transformation, 9},
-    {"_imagerExtra_screened_poisson_dct", (DL_FUNC) &_imagerExtra_screened_poisson_dct, 2},
-    {"_imagerExtra_saturateim", (DL_FUNC) &_imagerExtra_saturateim, 5},
+    {"_imagerExtra_screened_poisson_equation", (DL_FUNC) &_imagerExtra_screened_poisson_equation, 5},
+    {"_imagerExtra_balance_simplest", (DL_FUNC) &_imagerExtra_balance_simplest, 5},
     {NULL, NULL, 0}
 };
 
@@ -18,34 +18,6 @@
 
 #include <Rcpp.h>
 
-// [[Rcpp::export]]
-Rcpp::NumericVector make_histogram_ADPHE(const Rcpp::NumericVector& ordered, const Rcpp::NumericVector& interval)
-{
-  int n = ordered.size();
-  int m = interval.size();
-  Rcpp::NumericVector res(m);
-  int count = 0;
-  for (int i = 0; i < n; ++i)
-  {
-    if (ordered[i] <= interval[count])
-    {
-      ++res[count];
-    } else 
-    {
-      while (ordered[i] > interval[count])
-      {
-        ++count; 
-      }
-      if (count >= m)
-      {
-        break;
-      }
-      ++res[count]; 
-    }
-  }
-  return res;
-}
-
 // [[Rcpp::export]]
 Rcpp::NumericVector find_local_maximum_ADPHE(const Rcpp::NumericVector& hist, int n)
 {
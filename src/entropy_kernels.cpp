@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2018, Shota Ochi <shotaochi1990@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//$ Logarithm kernels of the entropy objectives of the thresholding functions.
+//$ The SIMD kernels are compiled with target attributes and selected at run time,
+//$ so the package itself is built with the default compiler flags.
+//$ The scalar kernels are plain loops which the compiler vectorizes with the baseline
+//$ instructions (SSE2 or NEON).
+
+#include "entropy_kernels.h"
+#include "fp_contract.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IMAGEREXTRA_ENTROPY_X86 1
+#include <immintrin.h>
+#endif
+
+// x = 2^e m with m in [sqrt(2) / 2, sqrt(2)), and log(1 + f) for f = m - 1 is
+// computed by the polynomial of fdlibm in s = f / (2 + f). The approximate
+// logarithm keeps the first three terms of the polynomial.
+static const double ENTROPY_LN2_HI = 6.93147180369123816490e-01;
+static const double ENTROPY_LN2_LO = 1.90821492927058770002e-10;
+static const double ENTROPY_SQRT2 = 1.41421356237309504880;
+static const double ENTROPY_LG1 = 6.666666666666735130e-01;
+static const double ENTROPY_LG2 = 3.999999999940941908e-01;
+static const double ENTROPY_LG3 = 2.857142874366239149e-01;
+static const double ENTROPY_LG4 = 2.222219843214978396e-01;
+static const double ENTROPY_LG5 = 1.818357216161805012e-01;
+static const double ENTROPY_LG6 = 1.531383769920937332e-01;
+static const double ENTROPY_LG7 = 1.479819860511658591e-01;
+static const uint64_t ENTROPY_MANTISSA = 0x000fffffffffffffULL;
+static const uint64_t ENTROPY_ONE = 0x3ff0000000000000ULL;
+static const uint64_t ENTROPY_TWO52 = 0x4330000000000000ULL;
+
+template<bool approx>
+IMAGEREXTRA_NO_FP_CONTRACT_NO_TRAP
+static inline double entropy_log_one(double x)
+{
+  uint64_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  // the exponent is converted to double by adding its bits to those of 2^52, as SSE2 has no conversion from int64
+  uint64_t ebits = (bits >> 52) | ENTROPY_TWO52;
+  double e;
+  std::memcpy(&e, &ebits, sizeof(e));
+  e -= 4503599627370496.0 + 1023.0;
+  uint64_t mbits = (bits & ENTROPY_MANTISSA) | ENTROPY_ONE;
+  double m;
+  std::memcpy(&m, &mbits, sizeof(m));
+  // constants are selected so that the rest isn't duplicated for the two cases in vectorized loops
+  double scale = m > ENTROPY_SQRT2 ? 0.5 : 1.0;
+  double carry = m > ENTROPY_SQRT2 ? 1.0 : 0.0;
+  m *= scale;
+  e += carry;
+  double f = m - 1.0;
+  double s = f / (2.0 + f);
+  double z = s * s;
+  double r;
+  if (approx)
+  {
+    r = z * (ENTROPY_LG1 + z * (ENTROPY_LG2 + z * ENTROPY_LG3));
+  } else
+  {
+    double w = z * z;
+    double t1 = w * (ENTROPY_LG2 + w * (ENTROPY_LG4 + w * ENTROPY_LG6));
+    double t2 = z * (ENTROPY_LG1 + w * (ENTROPY_LG3 + w * (ENTROPY_LG5 + w * ENTROPY_LG7)));
+    r = t2 + t1;
+  }
+  double hfsq = 0.5 * f * f;
+  return e * ENTROPY_LN2_HI - ((hfsq - (s * (hfsq + r) + e * ENTROPY_LN2_LO)) - f);
+}
+
+IMAGEREXTRA_NO_FP_CONTRACT_NO_TRAP
+static inline double entropy_xlogx_one(double x)
+{
+  // entropy_log_one is finite for any x, so the result is selected after the logarithm.
+  // Selecting the argument instead makes the compiler compute the logarithm twice in vectorized loops.
+  double res = x * entropy_log_one<false>(x);
+  return x > 0.0 ? res : 0.0;
+}
+
+IMAGEREXTRA_NO_FP_CONTRACT_NO_TRAP
+static inline double entropy_shannon_one(double x)
+{
+  // selected after the logarithms as in entropy_xlogx_one
+  double q = 1.0 - x;
+  double res = -x * entropy_log_one<false>(x) - q * entropy_log_one<false>(q);
+  return x > 0.0 && x < 1.0 ? res : 0.0;
+}
+
+IMAGEREXTRA_NO_FP_CONTRACT_NO_TRAP
+static void entropy_log_scalar(const double* x, int n, double* y)
+{
+  #pragma omp simd
+  for (int i = 0; i < n; ++i)
+  {
+    y[i] = entropy_log_one<false>(x[i]);
+  }
+}
+
+IMAGEREXTRA_NO_FP_CONTRACT_NO_TRAP
+static void entropy_log_approx_scalar(const double* x, int n, double* y)
+{
+  #pragma omp simd
+  for (int i = 0; i < n; ++i)
+  {
+    y[i] = entropy_log_one<true>(x[i]);
+  }
+}
+
+IMAGEREXTRA_NO_FP_CONTRACT_NO_TRAP
+static void entropy_xlogx_scalar(const double* x, int n, double* y)
+{
+  #pragma omp simd
+  for (int i = 0; i < n; ++i)
+  {
+    y[i] = entropy_xlogx_one(x[i]);
+  }
+}
+
+IMAGEREXTRA_NO_FP_CONTRACT_NO_TRAP
+static void entropy_shannon_scalar(const double* x, int n, double* y)
+{
+  #pragma omp simd
+  for (int i = 0; i < n; ++i)
+  {
+    y[i] = entropy_shannon_one(x[i]);
+  }
+}
+
+#ifdef IMAGEREXTRA_ENTROPY_X86
+
+// the same operations as entropy_log_one on 4 doubles.
+// the exponent is converted to double by adding the bits to those of 2^52.
+template<bool approx>
+__attribute__((target("avx2"))) IMAGEREXTRA_NO_FP_CONTRACT_NO_TRAP
+static inline __m256d entropy_log_avx2_one(__m256d x)
+{
+  const __m256i bits = _mm256_castpd_si256(x);
+  const __m256i ebits = _mm256_or_si256(_mm256_srli_epi64(bits, 52), _mm256_set1_epi64x(0x4330000000000000LL));
+  __m256d e = _mm256_sub_pd(_mm256_castsi256_pd(ebits), _mm256_set1_pd(4503599627370496.0 + 1023.0));
+  __m256d m = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi64x(ENTROPY_MANTISSA)), _mm256_set1_epi64x(ENTROPY_ONE)));
+  const __m256d big = _mm256_cmp_pd(m, _mm256_set1_pd(ENTROPY_SQRT2), _CMP_GT_OQ);
+  m = _mm256_blendv_pd(m, _mm256_mul_pd(m, _mm256_set1_pd(0.5)), big);
+  e = _mm256_blendv_pd(e, _mm256_add_pd(e, _mm256_set1_pd(1.0)), big);
+  const __m256d f = _mm256_sub_pd(m, _mm256_set1_pd(1.0));
+  const __m256d s = _mm256_div_pd(f, _mm256_add_pd(_mm256_set1_pd(2.0), f));
+  const __m256d z = _mm256_mul_pd(s, s);
+  __m256d r;
+  if (approx)
+  {
+    r = _mm256_add_pd(_mm256_set1_pd(ENTROPY_LG2), _mm256_mul_pd(z, _mm256_set1_pd(ENTROPY_LG3)));
+    r = _mm256_mul_pd(z, _mm256_add_pd(_mm256_set1_pd(ENTROPY_LG1), _mm256_mul_pd(z, r)));
+  } else
+  {
+    const __m256d w = _mm256_mul_pd(z, z);
+    __m256d t1 = _mm256_add_pd(_mm256_set1_pd(ENTROPY_LG4), _mm256_mul_pd(w, _mm256_set1_pd(ENTROPY_LG6)));
+    t1 = _mm256_mul_pd(w, _mm256_add_pd(_mm256_set1_pd(ENTROPY_LG2), _mm256_mul_pd(w, t1)));
+    __m256d t2 = _mm256_add_pd(_mm256_set1_pd(ENTROPY_LG5), _mm256_mul_pd(w, _mm256_set1_pd(ENTROPY_LG7)));
+    t2 = _mm256_add_pd(_mm256_set1_pd(ENTROPY_LG3), _mm256_mul_pd(w, t2));
+    t2 = _mm256_mul_pd(z, _mm256_add_pd(_mm256_set1_pd(ENTROPY_LG1), _mm256_mul_pd(w, t2)));
+    r = _mm256_add_pd(t2, t1);
+  }
+  const __m256d hfsq = _mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(0.5), f), f);
+  __m256d res = _mm256_add_pd(_mm256_mul_pd(s, _mm256_add_pd(hfsq, r)), _mm256_mul_pd(e, _mm256_set1_pd(ENTROPY_LN2_LO)));
+  res = _mm256_sub_pd(_mm256_sub_pd(hfsq, res), f);
+  return _mm256_sub_pd(_mm256_mul_pd(e, _mm256_set1_pd(ENTROPY_LN2_HI)), res);
+}
+
+__attribute__((target("avx2"))) IMAGEREXTRA_NO_FP_CONTRACT_NO_TRAP
+static void entropy_log_avx2(const double* x, int n, double* y)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    _mm256_storeu_pd(y + i, entropy_log_avx2_one<false>(_mm256_loadu_pd(x + i)));
+  }
+  for (; i < n; ++i)
+  {
+    y[i] = entropy_log_one<false>(x[i]);
+  }
+}
+
+__attribute__((target("avx2"))) IMAGEREXTRA_NO_FP_CONTRACT_NO_TRAP
+static void entropy_log_approx_avx2(const double* x, int n, double* y)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    _mm256_storeu_pd(y + i, entropy_log_avx2_one<true>(_mm256_loadu_pd(x + i)));
+  }
+  for (; i < n; ++i)
+  {
+    y[i] = entropy_log_one<true>(x[i]);
+  }
+}
+
+__attribute__((target("avx2"))) IMAGEREXTRA_NO_FP_CONTRACT_NO_TRAP
+static void entropy_xlogx_avx2(const double* x, int n, double* y)
+{
+  const __m256d zero = _mm256_setzero_pd();
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    const __m256d xi = _mm256_loadu_pd(x + i);
+    const __m256d res = _mm256_mul_pd(xi, entropy_log_avx2_one<false>(xi));
+    _mm256_storeu_pd(y + i, _mm256_and_pd(res, _mm256_cmp_pd(xi, zero, _CMP_GT_OQ)));
+  }
+  for (; i < n; ++i)
+  {
+    y[i] = entropy_xlogx_one(x[i]);
+  }
+}
+
+__attribute__((target("avx2"))) IMAGEREXTRA_NO_FP_CONTRACT_NO_TRAP
+static void entropy_shannon_avx2(const double* x, int n, double* y)
+{
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d one = _mm256_set1_pd(1.0);
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    const __m256d xi = _mm256_loadu_pd(x + i);
+    const __m256d inside = _mm256_and_pd(_mm256_cmp_pd(xi, zero, _CMP_GT_OQ), _mm256_cmp_pd(xi, one, _CMP_LT_OQ));
+    const __m256d q = _mm256_sub_pd(one, xi);
+    const __m256d negx = _mm256_sub_pd(zero, xi);
+    const __m256d res = _mm256_sub_pd(_mm256_mul_pd(negx, entropy_log_avx2_one<false>(xi)), _mm256_mul_pd(q, entropy_log_avx2_one<false>(q)));
+    _mm256_storeu_pd(y + i, _mm256_and_pd(res, inside));
+  }
+  for (; i < n; ++i)
+  {
+    y[i] = entropy_shannon_one(x[i]);
+  }
+}
+
+#endif
+
+int entropy_kernel_available(entropy_kernel* kernels, int maxnum)
+{
+  int count = 0;
+  if (count < maxnum)
+  {
+    kernels[count].name = "scalar";
+    kernels[count].width = 1;
+    kernels[count].log = entropy_log_scalar;
+    kernels[count].log_approx = entropy_log_approx_scalar;
+    kernels[count].xlogx = entropy_xlogx_scalar;
+    kernels[count].shannon = entropy_shannon_scalar;
+    ++count;
+  }
+#ifdef IMAGEREXTRA_ENTROPY_X86
+  __builtin_cpu_init();
+  if (count < maxnum && __builtin_cpu_supports("avx2"))
+  {
+    kernels[count].name = "avx2";
+    kernels[count].width = 4;
+    kernels[count].log = entropy_log_avx2;
+    kernels[count].log_approx = entropy_log_approx_avx2;
+    kernels[count].xlogx = entropy_xlogx_avx2;
+    kernels[count].shannon = entropy_shannon_avx2;
+    ++count;
+  }
+#endif
+  return count;
+}
+
+static entropy_kernel entropy_kernel_select()
+{
+  entropy_kernel kernels[2];
+  int count = entropy_kernel_available(kernels, 2);
+  return kernels[count - 1];
+}
+
+const entropy_kernel& entropy_kernel_best()
+{
+  static const entropy_kernel best = entropy_kernel_select();
+  return best;
+}
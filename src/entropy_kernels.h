@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2018, Shota Ochi <shotaochi1990@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGEREXTRA_ENTROPY_KERNELS_H
+#define IMAGEREXTRA_ENTROPY_KERNELS_H
+
+// y[i] = f(x[i]) for i < n. x and y may be the same array.
+// Every kernel evaluates the same operations in the same order without fused
+// multiply-add, so all the kernels return the same result as the scalar one.
+typedef void (*entropy_unary_kernel)(const double* x, int n, double* y);
+
+struct entropy_kernel
+{
+  const char* name;
+  int width; // number of doubles processed by one instruction
+  // log x for positive normal x, with error of at most 1 ulp
+  entropy_unary_kernel log;
+  // log x for positive normal x, with relative error below 1e-7
+  entropy_unary_kernel log_approx;
+  // x log x for non-negative x, 0 where x is 0
+  entropy_unary_kernel xlogx;
+  // Shannon function -x log x - (1 - x) log(1 - x), 0 where x is not in (0, 1)
+  entropy_unary_kernel shannon;
+};
+
+// fastest kernel supported by the running CPU (AVX2 or scalar)
+const entropy_kernel& entropy_kernel_best();
+
+// all the kernels supported by the running CPU, the scalar one first
+int entropy_kernel_available(entropy_kernel* kernels, int maxnum);
+
+#endif
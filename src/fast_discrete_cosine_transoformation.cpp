@@ -19,149 +19,204 @@
 //$ reference: Makhoul, J. (1980). A fast cosine transform in one and two dimensions. IEEE Transactions on Acoustics, Speech, and Signal Processing. 28 (1): 27-34. 
 
 #include <Rcpp.h>
+#include <map>
+#include "fast_discrete_cosine_transoformation.h"
 
-// [[Rcpp::export]]
-Rcpp::NumericMatrix DCT2D_reorder(Rcpp::NumericMatrix mat) {
-  int nrow = mat.nrow();
-  int ncol = mat.ncol();
-  Rcpp::NumericMatrix res(nrow, ncol);
+DCT2Dplan::DCT2Dplan(int nrow, int ncol) : fft_col(nrow), fft_row(ncol), tw_col(nrow), tw_row(ncol)
+{
+  for (int k = 0; k < nrow; ++k) {
+    double phase = -M_PI * k / (2.0 * nrow);
+    tw_col[k] = FFTcomplex(cos(phase), sin(phase));
+  }
+  for (int k = 0; k < ncol; ++k) {
+    double phase = -M_PI * k / (2.0 * ncol);
+    tw_row[k] = FFTcomplex(cos(phase), sin(phase));
+  }
+}
 
-  int nrowp1_half = (nrow + 1) / 2;
-  int ncolp1_half = (ncol + 1) / 2;
-  for (int i = 0; i < nrowp1_half; ++i) {
-    for (int j = 0; j < ncolp1_half; ++j) {
-      res(i,j) = mat(2*i, 2*j);
-    }
-    for (int j = ncolp1_half; j < ncol; ++j) {
-      res(i,j) = mat(2*i, 2*ncol-2*j-1);
+// 1D DCTs of num lines of length len in place. The element i of the line l
+// is data[l * line_stride + i * elem_stride].
+// Makhoul's reordering puts the even samples in increasing order and then the
+// odd samples in decreasing order, so that the DCT is the real part of the
+// DFT of the reordered line times exp(-pi i k / (2 len)). The reordered lines
+// are real, so the lines a and b are transformed together as a + i b.
+void DCT2Dplan::lines(double* data, int num, int len, int elem_stride, int line_stride, const FFTplan& fft, const std::vector<FFTcomplex>& tw, bool inv) const
+{
+  std::vector<FFTcomplex> z(len);
+  std::vector<FFTcomplex> zf(len);
+  std::vector<FFTcomplex> work(fft.work_size() + 1);
+  int len_even = (len + 1) / 2;
+  int len_odd = len / 2;
+  const FFTcomplex I(0.0, 1.0);
+
+  for (int l = 0; l < num; l += 2) {
+    double* a = data + l * line_stride;
+    double* b = l + 1 < num ? a + line_stride : NULL;
+
+    if (!inv) {
+      for (int i = 0; i < len_even; ++i) {
+        z[i] = FFTcomplex(a[2 * i * elem_stride], b != NULL ? b[2 * i * elem_stride] : 0.0);
+      }
+      for (int i = 0; i < len_odd; ++i) {
+        z[len - 1 - i] = FFTcomplex(a[(2 * i + 1) * elem_stride], b != NULL ? b[(2 * i + 1) * elem_stride] : 0.0);
+      }
+      fft.forward(&z[0], &zf[0], &work[0]);
+      for (int k = 0; k < len; ++k) {
+        // separate the DFTs of the two real lines
+        FFTcomplex zk = zf[k];
+        FFTcomplex zc = std::conj(zf[k == 0 ? 0 : len - k]);
+        a[k * elem_stride] = std::real(tw[k] * (zk + zc)) * 0.5;
+        if (b != NULL) {
+          b[k * elem_stride] = std::real(tw[k] * (zk - zc) * (-0.5 * I));
+        }
+      }
+    } else {
+      // the DFT of the reordered line is exp(pi i k / (2 len)) (X(k) - i X(len - k)), X(len) = 0
+      for (int k = 0; k < len; ++k) {
+        int kc = len - k;
+        FFTcomplex ua(a[k * elem_stride], k == 0 ? 0.0 : -a[kc * elem_stride]);
+        FFTcomplex ub(0.0, 0.0);
+        if (b != NULL) {
+          ub = FFTcomplex(b[k * elem_stride], k == 0 ? 0.0 : -b[kc * elem_stride]);
+        }
+        zf[k] = std::conj(tw[k]) * (ua + I * ub);
+      }
+      fft.inverse(&zf[0], &z[0], &work[0]);
+      for (int i = 0; i < len_even; ++i) {
+        a[2 * i * elem_stride] = z[i].real() / len;
+        if (b != NULL) {
+          b[2 * i * elem_stride] = z[i].imag() / len;
+        }
+      }
+      for (int i = 0; i < len_odd; ++i) {
+        a[(2 * i + 1) * elem_stride] = z[len - 1 - i].real() / len;
+        if (b != NULL) {
+          b[(2 * i + 1) * elem_stride] = z[len - 1 - i].imag() / len;
+        }
+      }
     }
   }
-  for (int i = nrowp1_half; i < nrow; ++i) {
-    for (int j = 0; j < ncolp1_half; ++j) {
-      res(i,j) = mat(2*nrow-2*i-1, 2*j);
-    }
-    for (int j = ncolp1_half; j < ncol; ++j) {
-      res(i,j) = mat(2*nrow-2*i-1, 2*ncol-2*j-1);
-    }
+}
+
+void DCT2Dplan::forward(const double* in, double* out) const
+{
+  int nr = nrow();
+  int nc = ncol();
+  if (in != out) {
+    std::copy(in, in + nr * nc, out);
   }
-  return res;  
+  lines(out, nc, nr, 1, nr, fft_col, tw_col, false);
+  lines(out, nr, nc, nr, 1, fft_row, tw_row, false);
 }
 
-Rcomplex calc_wm(int k, double m) {
-  double coef = -2 * M_PI * k / m;
-  Rcomplex res;
-  res.r = cos(coef);
-  res.i = sin(coef);
+void DCT2Dplan::inverse(const double* in, double* out) const
+{
+  int nr = nrow();
+  int nc = ncol();
+  if (in != out) {
+    std::copy(in, in + nr * nc, out);
+  }
+  lines(out, nr, nc, nr, 1, fft_row, tw_row, true);
+  lines(out, nc, nr, 1, nr, fft_col, tw_col, true);
+}
+
+// cache of the plans
+struct DCT2Dplan_cache
+{
+  std::map<std::pair<int, int>, std::shared_ptr<const DCT2Dplan> > plans;
+  int hits;
+  int misses;
+};
+
+static DCT2Dplan_cache& DCT2Dplan_cache_get()
+{
+  static DCT2Dplan_cache cache = {std::map<std::pair<int, int>, std::shared_ptr<const DCT2Dplan> >(), 0, 0};
+  return cache;
+}
+
+static std::shared_ptr<const DCT2Dplan> DCT2Dplan_lookup(int nrow, int ncol, bool count)
+{
+  DCT2Dplan_cache& cache = DCT2Dplan_cache_get();
+  std::shared_ptr<const DCT2Dplan> res;
+  #pragma omp critical(DCT2Dplan_cache)
+  {
+    std::pair<int, int> key(nrow, ncol);
+    std::map<std::pair<int, int>, std::shared_ptr<const DCT2Dplan> >::iterator it = cache.plans.find(key);
+    if (it != cache.plans.end()) {
+      res = it->second;
+      if (count) {
+        ++cache.hits;
+      }
+    } else {
+      res = std::make_shared<const DCT2Dplan>(nrow, ncol);
+      cache.plans[key] = res;
+      if (count) {
+        ++cache.misses;
+      }
+    }
+  }
   return res;
-} 
+}
 
-//$' calculate DCT2D from DFT2D
-// [[Rcpp::export]]
-Rcpp::NumericMatrix DCT2D_fromDFT(Rcpp::ComplexMatrix mat) {
-  int nrow = mat.nrow();
-  int ncol = mat.ncol();
-  double nrow4 = 4.0 * nrow;
-  double ncol4 = 4.0 * ncol;
-  Rcpp::NumericMatrix res(nrow, ncol);
+std::shared_ptr<const DCT2Dplan> DCT2Dplan_cached(int nrow, int ncol)
+{
+  return DCT2Dplan_lookup(nrow, ncol, true);
+}
 
-  for (int j = 0; j < ncol; ++j) {
-    int i = 0;
-    Rcomplex wk14N1 = calc_wm(i, nrow4);
-    Rcomplex wk24N2 = calc_wm(j, ncol4);
-    Rcomplex temp = wk14N1 * (wk24N2 * mat(i,j));
-    res(i,j) = temp.r;
+void DCT2Dplan_clear()
+{
+  DCT2Dplan_cache& cache = DCT2Dplan_cache_get();
+  #pragma omp critical(DCT2Dplan_cache)
+  {
+    cache.plans.clear();
+    cache.hits = 0;
+    cache.misses = 0;
   }
-  for (int i = 1; i < nrow; ++i) {
-    Rcomplex wk14N1 = calc_wm(i, nrow4);
-    int j = 0;
-    Rcomplex wk24N2 = calc_wm(j, ncol4);
-    Rcomplex temp = wk14N1 * (wk24N2 * mat(i,j));
-    res(i,j) = temp.r;
+}
+
+//$' create the plans of DCT2D of matrices of size nrow x ncol without counting hits or misses
+// [[Rcpp::export]]
+void DCT2D_cache_prewarm(Rcpp::IntegerVector nrow, Rcpp::IntegerVector ncol) {
+  for (int i = 0; i < nrow.size(); ++i) {
+    DCT2Dplan_lookup(nrow[i], ncol[i], false);
   }
-  for (int i = 1; i < nrow; ++i) {
-    Rcomplex wk14N1 = calc_wm(i, nrow4);
-    for (int j = 1; j < ncol; ++j) {
-      Rcomplex wk24N2 = calc_wm(j, ncol4);
-      Rcomplex wmik24N2 = calc_wm(-j, ncol4);
-      Rcomplex temp = wk14N1 * (wk24N2 * mat(i,j) + wmik24N2 * mat(i,ncol-j));
-      res(i,j) = temp.r * 0.5;
-    }
+}
+
+// [[Rcpp::export]]
+void DCT2D_cache_clear() {
+  DCT2Dplan_clear();
+}
+
+// [[Rcpp::export]]
+Rcpp::IntegerVector DCT2D_cache_stats() {
+  DCT2Dplan_cache& cache = DCT2Dplan_cache_get();
+  Rcpp::IntegerVector res(3);
+  #pragma omp critical(DCT2Dplan_cache)
+  {
+    res[0] = cache.hits;
+    res[1] = cache.misses;
+    res[2] = cache.plans.size();
   }
+  res.attr("names") = Rcpp::CharacterVector::create("hits", "misses", "plans");
   return res;
 }
 
-//$' calculate DFT2D from DCT2D
+//$' calculate DCT2D of a matrix in one pass
 // [[Rcpp::export]]
-Rcpp::ComplexMatrix IDCT2D_toDFT(Rcpp::NumericMatrix mat) {
+Rcpp::NumericMatrix DCT2D_fft(Rcpp::NumericMatrix mat) {
   int nrow = mat.nrow();
   int ncol = mat.ncol();
-  double nrow4 = 4.0 * nrow;
-  double ncol4 = 4.0 * ncol;
-  Rcpp::ComplexMatrix res(nrow, ncol);
-
-  res(0,0).r = mat(0,0);
-  res(0,0).i = 0.0;
-  for (int i = 1; i < nrow; ++i) {
-    int j = 0;
-    Rcomplex wmik14N1 = calc_wm(-i, nrow4);
-    Rcomplex wmik24N2 = calc_wm(-j, ncol4);
-    Rcomplex temp;
-    temp.r = mat(i,j);
-    temp.i = -mat(nrow-i,j);
-    Rcomplex temp2 = wmik14N1 * wmik24N2 * temp;
-    res(i,j).r = temp2.r;
-    res(i,j).i = temp2.i;
-  }
-  for (int j = 1; j < ncol; ++j) {
-    int i = 0;
-    Rcomplex wmik14N1 = calc_wm(-i, nrow4);
-    Rcomplex wmik24N2 = calc_wm(-j, ncol4);
-    Rcomplex temp;
-    temp.r = mat(i,j);
-    temp.i = -mat(i,ncol-j);
-    Rcomplex temp2 = wmik14N1 * wmik24N2 * temp;
-    res(i,j).r = temp2.r;
-    res(i,j).i = temp2.i;
-  }
-  for (int i = 1; i < nrow; ++i) {
-    Rcomplex wmik14N1 = calc_wm(-i, nrow4);
-    for (int j = 1; j < ncol; ++j) {
-      Rcomplex wmik24N2 = calc_wm(-j, ncol4);
-      Rcomplex temp;
-      temp.r = mat(i,j) - mat(nrow-i,ncol-j);
-      temp.i = -(mat(nrow-i,j) + mat(i,ncol-j));
-      Rcomplex temp2 = wmik14N1 * wmik24N2 * temp;
-      res(i,j).r = temp2.r;
-      res(i,j).i = temp2.i;
-    }
-  }
-
+  Rcpp::NumericMatrix res(nrow, ncol);
+  DCT2Dplan_cached(nrow, ncol)->forward(mat.begin(), res.begin());
   return res;
 }
 
+//$' calculate IDCT2D of a matrix in one pass
 // [[Rcpp::export]]
-Rcpp::NumericMatrix IDCT2D_retrievex(Rcpp::NumericMatrix mat) {
+Rcpp::NumericMatrix IDCT2D_fft(Rcpp::NumericMatrix mat) {
   int nrow = mat.nrow();
   int ncol = mat.ncol();
   Rcpp::NumericMatrix res(nrow, ncol);
-
-  int nrowp1_half = (nrow + 1) / 2;
-  int ncolp1_half = (ncol + 1) / 2;
-  for (int i = 0; i < nrowp1_half; ++i) {
-    for (int j = 0; j < ncolp1_half; ++j) {
-      res(2*i,2*j) = mat(i, j);
-    }
-    for (int j = ncolp1_half; j < ncol; ++j) {
-      res(2*i,2*ncol-2*j-1) = mat(i, j);
-    }
-  }
-  for (int i = nrowp1_half; i < nrow; ++i) {
-    for (int j = 0; j < ncolp1_half; ++j) {
-      res(2*nrow-2*i-1,2*j) = mat(i,j);
-    }
-    for (int j = ncolp1_half; j < ncol; ++j) {
-      res(2*nrow-2*i-1, 2*ncol-2*j-1) = mat(i,j);
-    }
-  }
-  return res;  
-}
\ No newline at end of file
+  DCT2Dplan_cached(nrow, ncol)->inverse(mat.begin(), res.begin());
+  return res;
+}
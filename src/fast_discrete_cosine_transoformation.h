@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2018, Shota Ochi <shotaochi1990@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGEREXTRA_FAST_DISCRETE_COSINE_TRANSOFORMATION_H
+#define IMAGEREXTRA_FAST_DISCRETE_COSINE_TRANSOFORMATION_H
+
+#include "fast_fourier_transformation.h"
+#include <memory>
+
+// Two dimensional DCT of column-major matrices of size nrow x ncol:
+// forward: out(k1,k2) = sum_{n1,n2} in(n1,n2) cos(pi k1 (2 n1 + 1) / (2 nrow)) cos(pi k2 (2 n2 + 1) / (2 ncol))
+// inverse: the exact inverse of forward.
+// The transform is separable. Each 1D DCT is computed by Makhoul's algorithm
+// with one complex FFT of the same size, and two real lines are packed into
+// one complex FFT.
+class DCT2Dplan
+{
+public:
+  DCT2Dplan(int nrow, int ncol);
+
+  int nrow() const { return fft_col.size(); }
+  int ncol() const { return fft_row.size(); }
+
+  // in and out may be the same.
+  void forward(const double* in, double* out) const;
+  void inverse(const double* in, double* out) const;
+
+private:
+  void lines(double* data, int num, int len, int elem_stride, int line_stride, const FFTplan& fft, const std::vector<FFTcomplex>& tw, bool inv) const;
+
+  FFTplan fft_col;                   // FFT of size nrow
+  FFTplan fft_row;                   // FFT of size ncol
+  std::vector<FFTcomplex> tw_col;    // exp(-pi i k / (2 nrow))
+  std::vector<FFTcomplex> tw_row;    // exp(-pi i k / (2 ncol))
+};
+
+// Plans are cached per process by (nrow, ncol), so repeated transforms of the
+// same size skip the FFT setup and the twiddle factors.
+// The plan is created on a cache miss. It stays valid after DCT2Dplan_clear.
+std::shared_ptr<const DCT2Dplan> DCT2Dplan_cached(int nrow, int ncol);
+
+// remove all the cached plans and reset the counts of hits and misses
+void DCT2Dplan_clear();
+
+#endif
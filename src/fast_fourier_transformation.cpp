@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2018, Shota Ochi <shotaochi1990@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//$ Complex FFT of arbitrary size used by the fast discrete cosine transformation.
+//$ reference: Bluestein, L. (1970). A linear filtering approach to the computation of discrete Fourier transform. IEEE Transactions on Audio and Electroacoustics. 18 (4): 451-455.
+
+#include "fast_fourier_transformation.h"
+#include <cmath>
+
+FFTplan::FFTplan(int n) : n(n), pow2(NULL)
+{
+  // factorize n into 4s, 2s, and odd factors
+  int rest = n;
+  int p = 4;
+  int floor_sqrt = (int)std::floor(std::sqrt((double)n));
+  bool small_factors = true;
+  while (rest > 1) {
+    while (rest % p != 0) {
+      if (p == 4) {
+        p = 2;
+      } else if (p == 2) {
+        p = 3;
+      } else {
+        p += 2;
+      }
+      if (p > floor_sqrt) {
+        p = rest;
+      }
+    }
+    if (p > FFT_MAX_RADIX) {
+      small_factors = false;
+      break;
+    }
+    rest /= p;
+    radix.push_back(p);
+    span.push_back(rest);
+  }
+
+  if (small_factors) {
+    tw_fwd.resize(n);
+    tw_inv.resize(n);
+    for (int k = 0; k < n; ++k) {
+      double phase = -2 * M_PI * k / n;
+      tw_fwd[k] = FFTcomplex(cos(phase), sin(phase));
+      tw_inv[k] = std::conj(tw_fwd[k]);
+    }
+    return;
+  }
+
+  // Bluestein's algorithm: the DFT is the convolution of in[j] * chirp[j]
+  // with conj(chirp), which is computed by FFTs of size m.
+  radix.clear();
+  span.clear();
+  int m = 1;
+  while (m < 2 * n - 1) {
+    m *= 2;
+  }
+  pow2 = new FFTplan(m);
+  chirp.resize(n);
+  for (int k = 0; k < n; ++k) {
+    // k^2 mod 2n keeps the phase accurate for large k
+    long long k2 = ((long long)k * k) % (2LL * n);
+    double phase = -M_PI * k2 / n;
+    chirp[k] = FFTcomplex(cos(phase), sin(phase));
+  }
+  std::vector<FFTcomplex> b(m, FFTcomplex(0.0, 0.0));
+  b[0] = std::conj(chirp[0]);
+  for (int k = 1; k < n; ++k) {
+    b[k] = std::conj(chirp[k]);
+    b[m - k] = std::conj(chirp[k]);
+  }
+  chirp_fft.resize(m);
+  pow2->forward(&b[0], &chirp_fft[0], NULL);
+  for (int k = 0; k < m; ++k) {
+    chirp_fft[k] /= (double)m;
+  }
+}
+
+FFTplan::~FFTplan()
+{
+  delete pow2;
+}
+
+int FFTplan::work_size() const
+{
+  return pow2 == NULL ? 0 : 2 * pow2->size();
+}
+
+void FFTplan::forward(const FFTcomplex* in, FFTcomplex* out, FFTcomplex* work) const
+{
+  transform(in, out, work, false);
+}
+
+void FFTplan::inverse(const FFTcomplex* in, FFTcomplex* out, FFTcomplex* work) const
+{
+  transform(in, out, work, true);
+}
+
+void FFTplan::transform(const FFTcomplex* in, FFTcomplex* out, FFTcomplex* work, bool inv) const
+{
+  if (pow2 != NULL) {
+    bluestein(in, out, work, inv);
+  } else if (n == 1) {
+    out[0] = in[0];
+  } else {
+    cooley_tukey(out, in, 1, 0, inv);
+  }
+}
+
+// Decimation in time: the p sub-transforms of size m = n / p of the stage are
+// computed into consecutive blocks of out, and combined by butterflies of radix p.
+void FFTplan::cooley_tukey(FFTcomplex* out, const FFTcomplex* in, int fstride, int stage, bool inv) const
+{
+  const int p = radix[stage];
+  const int m = span[stage];
+  const FFTcomplex* tw = inv ? &tw_inv[0] : &tw_fwd[0];
+
+  if (m == 1) {
+    for (int q = 0; q < p; ++q) {
+      out[q] = in[q * fstride];
+    }
+  } else {
+    for (int q = 0; q < p; ++q) {
+      cooley_tukey(out + q * m, in + q * fstride, fstride * p, stage + 1, inv);
+    }
+  }
+
+  if (p == 2) {
+    for (int u = 0; u < m; ++u) {
+      FFTcomplex t = out[u + m] * tw[u * fstride];
+      out[u + m] = out[u] - t;
+      out[u] += t;
+    }
+  } else if (p == 4) {
+    for (int u = 0; u < m; ++u) {
+      FFTcomplex s0 = out[u + m] * tw[u * fstride];
+      FFTcomplex s1 = out[u + 2 * m] * tw[2 * u * fstride];
+      FFTcomplex s2 = out[u + 3 * m] * tw[3 * u * fstride];
+      FFTcomplex s5 = out[u] - s1;
+      FFTcomplex s3 = s0 + s2;
+      FFTcomplex s4 = s0 - s2;
+      out[u] += s1;
+      out[u + 2 * m] = out[u] - s3;
+      out[u] += s3;
+      // s4 * (-i) for the forward transform, s4 * i for the inverse one
+      FFTcomplex s4_rot = inv ? FFTcomplex(-s4.imag(), s4.real()) : FFTcomplex(s4.imag(), -s4.real());
+      out[u + m] = s5 + s4_rot;
+      out[u + 3 * m] = s5 - s4_rot;
+    }
+  } else {
+    FFTcomplex scratch[FFT_MAX_RADIX];
+    for (int u = 0; u < m; ++u) {
+      for (int q = 0; q < p; ++q) {
+        scratch[q] = out[u + q * m];
+      }
+      for (int q1 = 0; q1 < p; ++q1) {
+        int k = u + q1 * m;
+        int twidx = 0;
+        FFTcomplex acc = scratch[0];
+        for (int q = 1; q < p; ++q) {
+          twidx += fstride * k;
+          if (twidx >= n) {
+            twidx -= n;
+          }
+          acc += scratch[q] * tw[twidx];
+        }
+        out[k] = acc;
+      }
+    }
+  }
+}
+
+// The inverse transform is conj(forward(conj(in))).
+void FFTplan::bluestein(const FFTcomplex* in, FFTcomplex* out, FFTcomplex* work, bool inv) const
+{
+  const int m = pow2->size();
+  FFTcomplex* a = work;
+  FFTcomplex* a_fft = work + m;
+
+  for (int k = 0; k < n; ++k) {
+    a[k] = (inv ? std::conj(in[k]) : in[k]) * chirp[k];
+  }
+  for (int k = n; k < m; ++k) {
+    a[k] = FFTcomplex(0.0, 0.0);
+  }
+  pow2->forward(a, a_fft, NULL);
+  for (int k = 0; k < m; ++k) {
+    a_fft[k] *= chirp_fft[k];
+  }
+  pow2->inverse(a_fft, a, NULL);
+  for (int k = 0; k < n; ++k) {
+    FFTcomplex res = a[k] * chirp[k];
+    out[k] = inv ? std::conj(res) : res;
+  }
+}
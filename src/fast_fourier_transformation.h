@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2018, Shota Ochi <shotaochi1990@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGEREXTRA_FAST_FOURIER_TRANSFORMATION_H
+#define IMAGEREXTRA_FAST_FOURIER_TRANSFORMATION_H
+
+#include <complex>
+#include <vector>
+
+typedef std::complex<double> FFTcomplex;
+
+// Unnormalized complex FFT of size n:
+// forward: out[k] = sum_j in[j] exp(-2 pi i j k / n)
+// inverse: out[k] = sum_j in[j] exp(+2 pi i j k / n)
+// Sizes whose prime factors are at most FFT_MAX_RADIX are computed by
+// mixed-radix Cooley-Tukey, other sizes by Bluestein's algorithm on a
+// power-of-2 FFT. The twiddle factors are computed once by the constructor,
+// so a plan can be shared by any number of transforms and threads.
+#define FFT_MAX_RADIX 31
+
+class FFTplan
+{
+public:
+  explicit FFTplan(int n);
+  ~FFTplan();
+
+  int size() const { return n; }
+
+  // number of FFTcomplex of the work buffer passed to forward and inverse
+  int work_size() const;
+
+  // in and out must not overlap.
+  void forward(const FFTcomplex* in, FFTcomplex* out, FFTcomplex* work) const;
+  void inverse(const FFTcomplex* in, FFTcomplex* out, FFTcomplex* work) const;
+
+private:
+  FFTplan(const FFTplan&);
+  FFTplan& operator=(const FFTplan&);
+
+  void transform(const FFTcomplex* in, FFTcomplex* out, FFTcomplex* work, bool inv) const;
+  void cooley_tukey(FFTcomplex* out, const FFTcomplex* in, int fstride, int stage, bool inv) const;
+  void bluestein(const FFTcomplex* in, FFTcomplex* out, FFTcomplex* work, bool inv) const;
+
+  int n;
+  std::vector<int> radix;            // radix of each stage
+  std::vector<int> span;             // size of the sub-transforms of each stage
+  std::vector<FFTcomplex> tw_fwd;    // exp(-2 pi i k / n)
+  std::vector<FFTcomplex> tw_inv;    // exp(+2 pi i k / n)
+
+  // Bluestein's algorithm
+  FFTplan* pow2;                     // FFT of size m >= 2n - 1
+  std::vector<FFTcomplex> chirp;     // exp(-pi i k^2 / n)
+  std::vector<FFTcomplex> chirp_fft; // FFT of the conjugate chirp, divided by m
+};
+
+#endif
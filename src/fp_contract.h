@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2018, Shota Ochi <shotaochi1990@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGEREXTRA_FP_CONTRACT_H
+#define IMAGEREXTRA_FP_CONTRACT_H
+
+// The kernels selected at run time must give the same results on every CPU, so their products and sums
+// must not be contracted into fused multiply-add. Compilers do so by default where the target has FMA
+// (e.g. target("avx512f"), -mfma, -march=native, or aarch64). IMAGEREXTRA_NO_FP_CONTRACT is put on every
+// kernel and on every inline function they call.
+// IMAGEREXTRA_NO_FP_CONTRACT_NO_TRAP also lets the compiler assume that the floating-point operations don't
+// trap, which doesn't change the results but lets it compute both sides of a selection, so that plain loops
+// with selections are vectorized with the baseline instructions. The functions inlined into one another must
+// have the same of the two.
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#define IMAGEREXTRA_NO_FP_CONTRACT
+#define IMAGEREXTRA_NO_FP_CONTRACT_NO_TRAP
+#elif defined(__GNUC__)
+#define IMAGEREXTRA_NO_FP_CONTRACT __attribute__((optimize("fp-contract=off")))
+#define IMAGEREXTRA_NO_FP_CONTRACT_NO_TRAP __attribute__((optimize("fp-contract=off", "no-trapping-math")))
+#else
+#define IMAGEREXTRA_NO_FP_CONTRACT
+#define IMAGEREXTRA_NO_FP_CONTRACT_NO_TRAP
+#endif
+
+#endif
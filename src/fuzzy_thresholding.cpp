@@ -17,183 +17,114 @@
  */
 
 #include <Rcpp.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "random_stream.h"
+#include "thresholding_objectives.h"
 
 #define N_PARAMS 2
 
-// [[Rcpp::export]]
-Rcpp::NumericVector make_histogram_fuzzy(Rcpp::NumericVector ordered, Rcpp::NumericVector interval)
+#define FUZZY_BLOCK 256
+
+// S-function membership at u = (x - a) / (c - a) for 0 <= u <= 1.
+// The two pieces are blended by arithmetic instead of selection so that the loops are vectorized.
+double membership_fuzzy(double u)
 {
-  int n = ordered.size();
-  int m = interval.size();
-  Rcpp::NumericVector res(m);
-  int count = 0;
-  for (int i = 0; i < n; ++i)
-  {
-    if (ordered[i] <= interval[count])
-    {
-      ++res[count];
-    } else 
-    {
-      while (ordered[i] > interval[count])
-      {
-        ++count; 
-      }
-      if (count >= m)
-      {
-        break;
-      }
-      ++res[count]; 
-    }
-  }
-  return res;
+  double upper = u >= 0.5;
+  return 2 * u * u * (1 - upper) + (1 - 2 * (1 - u) * (1 - u)) * upper;
 }
 
-double calc_fuzzy_entropy(Rcpp::NumericVector imhist, Rcpp::NumericVector interval, int idx_a, int idx_c)
+// The membership is 0 up to a and 1 from c, where the Shannon function is 0,
+// so only the bins between idx_a and idx_c are visited, FUZZY_BLOCK bins at a time.
+double calc_fuzzy_entropy(const entropy_kernel& kernel, const double* imhist, const double* interval, int idx_a, int idx_c)
 {
-  int n = imhist.size();
   double a = interval[idx_a];
   double c = interval[idx_c];
-  double b = (a + c) / 2;
   double res = 0.0;
-  for (int i = 0; i < n; ++i)
+  double mu[FUZZY_BLOCK];
+  double shannonf[FUZZY_BLOCK];
+  for (int i0 = idx_a + 1; i0 < idx_c; i0 += FUZZY_BLOCK)
   {
-    double mu = 0;
-    if (interval[i] > a)
+    int len = std::min(FUZZY_BLOCK, idx_c - i0);
+    const double* x = interval + i0;
+    #pragma omp simd
+    for (int i = 0; i < len; ++i)
     {
-      if (interval[i] < b)
-      {
-        mu = 2 * ((interval[i] - a) / (c - a)) * ((interval[i] - a) / (c - a));
-      } else if (interval[i] < c)
-      {
-        mu = 1 - 2 * ((c - interval[i]) / (c - a)) * ((c - interval[i]) / (c - a));
-      } else 
-      {
-        mu = 1;
-      }
+      mu[i] = membership_fuzzy((x[i] - a) / (c - a));
     }
-    double shannonf = 0.0;
-    if (mu != 0.0 && mu != 1.0)
+    kernel.shannon(mu, len, shannonf);
+    for (int i = 0; i < len; ++i)
     {
-      shannonf = -mu * std::log(mu) - (1 - mu) * std::log(1 - mu);
+      res += shannonf[i] * imhist[i0 + i];
     }
-    res += shannonf * imhist[i];
   }
   return res;
 }
 
-bool check_dupl_fuzzy(Rcpp::IntegerVector vec)
+bool check_dupl_fuzzy(const int* vec)
 {
-  int n = vec.size();
-  bool res = false;
-  for (int i = 0; i < n - 1; ++i)
+  for (int i = 0; i < N_PARAMS - 1; ++i)
   {
     if (vec[i] == vec[i+1])
     {
-      res = true;
-      break;
+      return true;
     }
   }
-  return res;
+  return false;
 }
 
-Rcpp::IntegerVector generate_pos_fuzzy(int n_interval)
+// n_interval must be greater than or equal to N_PARAMS.
+template<class RNG>
+void generate_pos_fuzzy(int n_interval, RNG& rng, int* res)
 {
-  Rcpp::IntegerVector res(N_PARAMS);
-  if (n_interval < N_PARAMS)
+  do
   {
-    Rcpp::Rcout << "n_interval is smaller than " << N_PARAMS << "." << std::endl;
-    return res;
-  }
-  Rcpp::NumericVector tmprand = Rcpp::runif(N_PARAMS, 0, n_interval);
-  for (int i = 0; i < N_PARAMS; ++i)
-  {
-    res[i] = (int)(tmprand[i]);
-  }
-  std::sort(res.begin(), res.end());
-  bool flag_dupl = check_dupl_fuzzy(res);
-  while (flag_dupl)
-  {
-    tmprand = Rcpp::runif(N_PARAMS, 0, n_interval);
     for (int i = 0; i < N_PARAMS; ++i)
     {
-      res[i] = (int)(tmprand[i]);
-    }
-    std::sort(res.begin(), res.end());
-    flag_dupl = check_dupl_fuzzy(res);
-  }
-  return res;
-}
-
-Rcpp::IntegerMatrix generate_inipos_fuzzy(int n, int n_interval)
-{
-  Rcpp::IntegerMatrix res(n, N_PARAMS);
-  for (int i = 0; i < n; ++i)
-  {
-    Rcpp::IntegerVector tmp = generate_pos_fuzzy(n_interval);
-    for (int j = 0; j < N_PARAMS; ++j)
-    {
-      res(i,j) = tmp[j];
+      res[i] = (int)rng.unif(0, n_interval);
     }
-  }
-  return res;
+    std::sort(res, res + N_PARAMS);
+  } while (check_dupl_fuzzy(res));
 }
 
-Rcpp::NumericMatrix generate_iniv_fuzzy(int n, double vmax)
+// One swarm of the particle swarm optimization followed by the local search.
+// The best (a, c) is written to gbest, and its entropy is returned.
+// It doesn't touch R objects, so swarms with their own RandomStream can run in parallel.
+template<class RNG>
+double pso_fuzzy(const entropy_kernel& kernel, const double* imhist, const double* interval, int n_interval, int n, int maxiter, double omegamax, double omegamin, double c1, double c2, double mutrate, double vmax, int localsearch, RNG& rng, int* gbest)
 {
-  Rcpp::NumericMatrix res(n, N_PARAMS);
+  // n x N_PARAMS row-major matrices
+  std::vector<int> pos(n * N_PARAMS);
+  std::vector<double> v(n * N_PARAMS);
   for (int i = 0; i < n; ++i)
   {
-    Rcpp::NumericVector tmp = Rcpp::runif(N_PARAMS, 0, 1);
-    for (int j = 0; j < N_PARAMS; ++j)
-    {
-      res(i,j) = vmax * (tmp[j] + tmp[j] - 1);
-    }
-  }
-  return res;
-}
-
-// [[Rcpp::export]]
-double fuzzy_threshold(Rcpp::NumericVector imhist, Rcpp::NumericVector interval, int n, int maxiter, double omegamax, double omegamin, double c1, double c2, double mutrate, double vmax, int localsearch)
-{
-  // sanity ckeck
-  if (imhist.size() != interval.size())
-  {
-    Rcpp::Rcout << "The length of imhist is not same as the length of interval." << std::endl;
-    return 0.0;
+    generate_pos_fuzzy(n_interval, rng, &pos[i * N_PARAMS]);
   }
-  if (maxiter < 2)
+  for (int i = 0; i < n * N_PARAMS; ++i)
   {
-    Rcpp::Rcout << "maxiter must be greater than or equal to 2." << std::endl;
-    return 0.0;
+    double tmp = rng.unif(0, 1);
+    v[i] = vmax * (tmp + tmp - 1);
   }
-  
-  int n_interval = interval.size();
-  Rcpp::IntegerMatrix pos = generate_inipos_fuzzy(n, n_interval);
-  Rcpp::NumericMatrix v = generate_iniv_fuzzy(n, vmax);
-  Rcpp::IntegerVector gbest(N_PARAMS);
+  gbest[0] = 0;
+  gbest[1] = 0;
   double gbeste = 0;
   double omegacoef = (omegamax - omegamin) / (maxiter - 1);
-  Rcpp::IntegerMatrix pbest(n,N_PARAMS); // a, c(from left to right)
-  Rcpp::NumericVector pbeste(n); // maximum entropy of each particles
+  std::vector<int> pbest(pos); // a, c(from left to right)
+  std::vector<double> pbeste(n); // maximum entropy of each particles
   double vmax_squared = vmax * vmax;
-  Rcpp::IntegerMatrix prepos(n,N_PARAMS);
-  Rcpp::NumericMatrix prev(n,N_PARAMS);
+  std::vector<int> prepos(pos);
+  std::vector<double> prev(v);
   double sigma = 0.1 * n_interval;
   
   for (int i = 0; i < n; ++i)
   {
-    for (int j = 0; j < N_PARAMS; ++j)
-    {
-      pbest(i,j) = pos(i,j);
-      prepos(i,j) = pos(i,j);
-      prev(i,j) = v(i,j);
-    }
-    pbeste[i] = calc_fuzzy_entropy(imhist, interval, pos(i,0), pos(i,1));
+    pbeste[i] = calc_fuzzy_entropy(kernel, imhist, interval, pos[i * N_PARAMS], pos[i * N_PARAMS + 1]);
     if (pbeste[i] > gbeste)
     {
       for (int j = 0; j < N_PARAMS; ++j)
       {
-        gbest[j] = pbest(i,j);
+        gbest[j] = pbest[i * N_PARAMS + j];
       }
       gbeste = pbeste[i];
     }   
@@ -203,13 +134,17 @@ double fuzzy_threshold(Rcpp::NumericVector imhist, Rcpp::NumericVector interval,
     double omegak = omegamax - k * omegacoef;
     for (int i = 0; i < n; ++i)
     {
+      int* posi = &pos[i * N_PARAMS];
+      double* vi = &v[i * N_PARAMS];
       bool flag_range = false;
       for (int j = 0; j < N_PARAMS; ++j)
       {
-        Rcpp::NumericVector temprunif = Rcpp::runif(2);
-        v(i,j) = v(i,j) * omegak + c1 * temprunif[0] * (pbest(i,j) - prepos(i,j)) + c2 * temprunif[1] * (gbest[j] - prepos(i,j));
-        pos(i,j) = (int)(prepos(i,j) + prev(i,j));
-        if (pos(i,j) < 0 || pos(i,j) >= n_interval)
+        int ij = i * N_PARAMS + j;
+        double r1 = rng.unif(0, 1);
+        double r2 = rng.unif(0, 1);
+        vi[j] = vi[j] * omegak + c1 * r1 * (pbest[ij] - prepos[ij]) + c2 * r2 * (gbest[j] - prepos[ij]);
+        posi[j] = (int)(prepos[ij] + prev[ij]);
+        if (posi[j] < 0 || posi[j] >= n_interval)
         {
           flag_range = true;
         }
@@ -217,42 +152,36 @@ double fuzzy_threshold(Rcpp::NumericVector imhist, Rcpp::NumericVector interval,
       double vmag = 0.0;
       for (int j = 0; j < N_PARAMS; ++j)
       {
-        vmag += v(i,j) * v(i,j);
+        vmag += vi[j] * vi[j];
       }
       if (vmag > vmax_squared)
       {
         double vmag_sqrt = sqrt(vmag);
         for (int j = 0; j < N_PARAMS; ++j)
         {
-          v(i,j) *= vmax / vmag_sqrt;
+          vi[j] *= vmax / vmag_sqrt;
         }
       }
       for (int j = 0; j < N_PARAMS - 1; ++j)
       {
-        if (pos(i,j) >= pos(i,j+1))
+        if (posi[j] >= posi[j+1])
         {
           flag_range = true;
         }
       }
       if (flag_range)
       {
-        Rcpp::IntegerVector tmp_newpos = generate_pos_fuzzy(n_interval);
-        for (int j = 0; j < N_PARAMS; ++j)
-        {
-          pos(i,j) = tmp_newpos[j];
-        }
+        generate_pos_fuzzy(n_interval, rng, posi);
       }
-      double tempe = calc_fuzzy_entropy(imhist, interval, pos(i,0), pos(i,1));
+      double tempe = calc_fuzzy_entropy(kernel, imhist, interval, posi[0], posi[1]);
       //gaussian mutation
-      Rcpp::NumericVector mutran = Rcpp::runif(1);
-      if (mutran[0] <= mutrate) 
+      if (rng.unif(0, 1) <= mutrate) 
       {
-        Rcpp::NumericVector tempgaus = Rcpp::rnorm(N_PARAMS,0,sigma);
-        Rcpp::IntegerVector tmppos(N_PARAMS);
+        int tmppos[N_PARAMS];
         bool bool_gaus = true;
         for (int j = 0; j < N_PARAMS; ++j)
         {
-          tmppos[j] = (int)(pos(i,j) * (1 + tempgaus[j]));
+          tmppos[j] = (int)(posi[j] * (1 + rng.norm(0, sigma)));
           if (tmppos[j] < 0 || tmppos[j] >= n_interval)
           {
             bool_gaus = false;
@@ -267,12 +196,12 @@ double fuzzy_threshold(Rcpp::NumericVector imhist, Rcpp::NumericVector interval,
         }
         if (bool_gaus)
         {
-          double mute = calc_fuzzy_entropy(imhist, interval, tmppos[0], tmppos[1]);
+          double mute = calc_fuzzy_entropy(kernel, imhist, interval, tmppos[0], tmppos[1]);
           if (mute > tempe)
           {
             for (int j = 0; j < N_PARAMS; ++j)
             { 
-              pos(i,j) = tmppos[j];
+              posi[j] = tmppos[j];
             }
             tempe = mute;
           }
@@ -283,29 +212,29 @@ double fuzzy_threshold(Rcpp::NumericVector imhist, Rcpp::NumericVector interval,
       {
         for (int j = 0; j < N_PARAMS; ++j)
         {
-          pbest(i,j) = pos(i,j);
+          pbest[i * N_PARAMS + j] = posi[j];
         }
         pbeste[i] = tempe;
         if (tempe >= gbeste)
         {
           for (int j = 0; j < N_PARAMS; ++j)
           {
-            gbest[j] = pos(i,j);
+            gbest[j] = posi[j];
           }
           gbeste = tempe;
         }
       }
       for (int j = 0; j < N_PARAMS; ++j)
       {
-        prepos(i,j) = pos(i,j);
-        prev(i,j) = v(i,j);
+        prepos[i * N_PARAMS + j] = posi[j];
+        prev[i * N_PARAMS + j] = vi[j];
       }
     }
   }
 
   // local search
-  Rcpp::IntegerVector localmin(N_PARAMS);
-  Rcpp::IntegerVector localmax(N_PARAMS);
+  int localmin[N_PARAMS];
+  int localmax[N_PARAMS];
   for (int j = 0; j < N_PARAMS; ++j)
   {
     localmin[j] = gbest[j] - localsearch  > 0 ? gbest[j] - localsearch : 0;
@@ -317,7 +246,7 @@ double fuzzy_threshold(Rcpp::NumericVector imhist, Rcpp::NumericVector interval,
     {
       if (ia < ic)
       {
-        double tempe = calc_fuzzy_entropy(imhist, interval, ia, ic);
+        double tempe = calc_fuzzy_entropy(kernel, imhist, interval, ia, ic);
         if (tempe > gbeste)
         {
           gbest[0] = ia;
@@ -327,6 +256,219 @@ double fuzzy_threshold(Rcpp::NumericVector imhist, Rcpp::NumericVector interval,
       }
     }
   }  
-  
-  return (interval[gbest[0]] + interval[gbest[1]]) / 2;
-}
\ No newline at end of file
+  return gbeste;
+}
+
+// Fuzzy thresholding by particle swarm optimization.
+// nruns: number of independent swarms. The threshold of the swarm of the
+//        largest entropy is returned, the first swarm in case of a tie.
+// seed: seed of the random number streams of the swarms. If seed is NA or NaN,
+//       one swarm runs with R's random number generator, and nruns must be 1.
+// nthreads: number of threads. the result does not depend on nthreads.
+// [[Rcpp::export]]
+double fuzzy_threshold(Rcpp::NumericVector imhist, Rcpp::NumericVector interval, int n, int maxiter, double omegamax, double omegamin, double c1, double c2, double mutrate, double vmax, int localsearch, int nruns, double seed, int nthreads)
+{
+  // sanity ckeck
+  if (imhist.size() != interval.size())
+  {
+    Rcpp::Rcout << "The length of imhist is not same as the length of interval." << std::endl;
+    return 0.0;
+  }
+  if (maxiter < 2)
+  {
+    Rcpp::Rcout << "maxiter must be greater than or equal to 2." << std::endl;
+    return 0.0;
+  }
+  int n_interval = interval.size();
+  if (n_interval < N_PARAMS)
+  {
+    Rcpp::Rcout << "n_interval is smaller than " << N_PARAMS << "." << std::endl;
+    return 0.0;
+  }
+  if (nruns < 1 || (std::isnan(seed) && nruns != 1))
+  {
+    Rcpp::Rcout << "nruns must be positive, and it must be 1 if seed is NA." << std::endl;
+    return 0.0;
+  }
+  if (nthreads < 1)
+  {
+    nthreads = 1;
+  }
+
+  const entropy_kernel& kernel = entropy_kernel_best();
+  std::vector<int> gbest(nruns * N_PARAMS);
+  std::vector<double> gbeste(nruns);
+  if (std::isnan(seed))
+  {
+    RandomR rng;
+    gbeste[0] = pso_fuzzy(kernel, imhist.begin(), interval.begin(), n_interval, n, maxiter, omegamax, omegamin, c1, c2, mutrate, vmax, localsearch, rng, &gbest[0]);
+  } else
+  {
+    const double* imhist_ptr = imhist.begin();
+    const double* interval_ptr = interval.begin();
+    #pragma omp parallel for num_threads(std::min(nthreads, nruns)) schedule(dynamic, 1)
+    for (int r = 0; r < nruns; ++r)
+    {
+      RandomStream rng((uint64_t)(int64_t)seed, r);
+      gbeste[r] = pso_fuzzy(kernel, imhist_ptr, interval_ptr, n_interval, n, maxiter, omegamax, omegamin, c1, c2, mutrate, vmax, localsearch, rng, &gbest[r * N_PARAMS]);
+    }
+  }
+  int best = 0;
+  for (int r = 1; r < nruns; ++r)
+  {
+    if (gbeste[r] > gbeste[best])
+    {
+      best = r;
+    }
+  }
+  return (interval[gbest[best * N_PARAMS]] + interval[gbest[best * N_PARAMS + 1]]) / 2;
+}
+
+// Shannon function of the S-function membership at u = (x - a) / (c - a) for 0 <= u <= 1.
+// This is the same as the summand of calc_fuzzy_entropy.
+double shannon_fuzzy(const entropy_kernel& kernel, double u)
+{
+  double mu = membership_fuzzy(u);
+  double res;
+  kernel.shannon(&mu, 1, &res);
+  return res;
+}
+
+// g[j] = shannon_fuzzy(j / d) for 0 <= j <= d. g must have d + 1 doubles.
+void kernel_fuzzy(const entropy_kernel& kernel, int d, double* g)
+{
+  for (int j = 0; j <= d; ++j)
+  {
+    g[j] = membership_fuzzy((double)j / d);
+  }
+  kernel.shannon(g, d + 1, g);
+}
+
+#define FUZZY_PARTS 16
+
+// bound[ia] = sum of the mass of the part p of the window (ia, ia + d) times s[p].
+// the parts are the outer loop so that the inner loop over ia is vectorized.
+void bound_fuzzy(const double* cumsum, int n_interval, int d, const double* s, double* bound)
+{
+  int m = n_interval - d;
+  std::fill(bound, bound + m, 0.0);
+  for (int p = 0; p < FUZZY_PARTS; ++p)
+  {
+    const double* cs0 = cumsum + (d * p + FUZZY_PARTS - 1) / FUZZY_PARTS;
+    const double* cs1 = cumsum + (d * (p + 1) + FUZZY_PARTS - 1) / FUZZY_PARTS;
+    double sp = s[p];
+    #pragma omp simd
+    for (int ia = 0; ia < m; ++ia)
+    {
+      bound[ia] += (cs1[ia] - cs0[ia]) * sp;
+    }
+  }
+}
+
+// entropy of the window of width d starting at hi with the kernel g.
+// all the entropies are summed by this loop so that they are rounded the same way and ties are exact.
+double window_fuzzy(const double* hi, const double* g, int d)
+{
+  double res = 0.0;
+  #pragma omp simd reduction(+:res)
+  for (int j = 1; j < d; ++j)
+  {
+    res += hi[j] * g[j];
+  }
+  return res;
+}
+
+// Fuzzy thresholding by evaluating all the pairs (a, c).
+// The bins have the same width, so the membership of bin a + j only depends on
+// j / (c - a), and the entropy of (a, c) is the sum of imhist[a + j] * g[j]
+// over 0 < j < c - a with the kernel g of the width c - a.
+// The window of each pair is split into FUZZY_PARTS parts of the same width in u.
+// The prefix sums of imhist give the mass of each part, and the maximum and the minimum
+// of the Shannon function in each part give an upper and a lower bound of the entropy in O(FUZZY_PARTS).
+// Only the pairs whose upper bound reaches the best entropy found are evaluated.
+// The pair of the largest entropy is returned, the narrowest and then the leftmost one in case of a tie.
+// [[Rcpp::export]]
+double fuzzy_threshold_exact(Rcpp::NumericVector imhist, Rcpp::NumericVector interval)
+{
+  // sanity ckeck
+  if (imhist.size() != interval.size())
+  {
+    Rcpp::Rcout << "The length of imhist is not same as the length of interval." << std::endl;
+    return 0.0;
+  }
+  int n_interval = interval.size();
+  if (n_interval < N_PARAMS)
+  {
+    Rcpp::Rcout << "n_interval is smaller than " << N_PARAMS << "." << std::endl;
+    return 0.0;
+  }
+
+  const entropy_kernel& kernel = entropy_kernel_best();
+  const double* h = imhist.begin();
+  std::vector<double> cumsum(n_interval + 1, 0.0);
+  for (int i = 0; i < n_interval; ++i)
+  {
+    cumsum[i+1] = cumsum[i] + h[i];
+  }
+  // bounds of the Shannon function in each part, widened a little against rounding errors.
+  // the Shannon function increases on [0, 0.5] and decreases on [0.5, 1].
+  double smax[FUZZY_PARTS];
+  double smin[FUZZY_PARTS];
+  for (int p = 0; p < FUZZY_PARTS; ++p)
+  {
+    double u0 = (double)p / FUZZY_PARTS;
+    double u1 = (double)(p + 1) / FUZZY_PARTS;
+    double s0 = shannon_fuzzy(kernel, u0);
+    double s1 = shannon_fuzzy(kernel, u1);
+    smax[p] = shannon_fuzzy(kernel, std::min(std::max(0.5, u0), u1)) * (1 + 1e-9);
+    smin[p] = std::min(s0, s1) * (1 - 1e-9);
+  }
+
+  std::vector<double> bound(n_interval);
+  // the pair of the largest lower bound gives the first best entropy.
+  int best_a = 0;
+  int best_d = 1;
+  double best_lb = -1.0;
+  for (int d = 2; d < n_interval; ++d)
+  {
+    bound_fuzzy(cumsum.data(), n_interval, d, smin, bound.data());
+    for (int ia = 0; ia + d < n_interval; ++ia)
+    {
+      if (bound[ia] > best_lb)
+      {
+        best_lb = bound[ia];
+        best_a = ia;
+        best_d = d;
+      }
+    }
+  }
+
+  std::vector<double> g(n_interval);
+  kernel_fuzzy(kernel, best_d, &g[0]);
+  double beste = window_fuzzy(h + best_a, &g[0], best_d);
+  for (int d = 2; d < n_interval; ++d)
+  {
+    bound_fuzzy(cumsum.data(), n_interval, d, smax, bound.data());
+    bool g_ready = false;
+    for (int ia = 0; ia + d < n_interval; ++ia)
+    {
+      if (bound[ia] < beste)
+      {
+        continue;
+      }
+      if (!g_ready)
+      {
+        kernel_fuzzy(kernel, d, &g[0]);
+        g_ready = true;
+      }
+      double tempe = window_fuzzy(h + ia, &g[0], d);
+      if (tempe > beste || (tempe == beste && (d < best_d || (d == best_d && ia < best_a))))
+      {
+        beste = tempe;
+        best_a = ia;
+        best_d = d;
+      }
+    }
+  }
+  return (interval[best_a] + interval[best_a + best_d]) / 2;
+}
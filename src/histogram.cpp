@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2018, Shota Ochi <shotaochi1990@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+//$ histogram shared by the thresholding and equalization functions
+
+#include <Rcpp.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "histogram.h"
+
+// number of values whose bins are computed at once before they are counted
+#define HISTOGRAM_BLOCK 256
+// number of sub-histograms of one thread. Consecutive values are counted in
+// different sub-histograms, so runs of the same bin, e.g. the background of
+// a document, don't stall on the same counter.
+#define HISTOGRAM_LANES 4
+// minimum number of values processed by one thread
+#define HISTOGRAM_GRAIN 65536
+
+static void histogram_minmax_chunk(const double* data, int n, double* minval, double* maxval)
+{
+  double mn = data[0];
+  double mx = data[0];
+  #pragma omp simd reduction(min:mn) reduction(max:mx)
+  for (int i = 1; i < n; ++i)
+  {
+    mn = data[i] < mn ? data[i] : mn;
+    mx = data[i] > mx ? data[i] : mx;
+  }
+  *minval = mn;
+  *maxval = mx;
+}
+
+// count the values of one chunk in its own sub-histograms of size lanes x m
+static void histogram_counts_chunk(const double* data, int n, const double* breaks, int m, unsigned int* bins)
+{
+  // bin k is (edges[k], edges[k + 1]]. The first bin includes the minimum.
+  std::vector<double> edges(breaks, breaks + m + 1);
+  edges[0] = -HUGE_VAL;
+  const double minval = breaks[0];
+  const double lastval = breaks[m];
+  const double scale = lastval > minval ? m / (lastval - minval) : 0.0;
+  const double maxguess = m - 1;
+  int guess[HISTOGRAM_BLOCK];
+  for (int start = 0; start < n; start += HISTOGRAM_BLOCK)
+  {
+    const double* block = data + start;
+    const int len = std::min(HISTOGRAM_BLOCK, n - start);
+    // bins of the uniform width, clamped without branches so that the loop is vectorized
+    #pragma omp simd
+    for (int j = 0; j < len; ++j)
+    {
+      double g = (block[j] - minval) * scale;
+      g = g >= 0 ? g : 0;
+      g = g < maxguess ? g : maxguess;
+      guess[j] = (int)g;
+    }
+    for (int j = 0; j < len; ++j)
+    {
+      const double v = block[j];
+      int k = guess[j];
+      if ((edges[k] < v) & (v <= edges[k + 1]))
+      {
+        ++bins[(j % HISTOGRAM_LANES) * m + k];
+        continue;
+      }
+      // The guess is off by one bin but for rounding. It is moved to the first
+      // upper edge not smaller than the value.
+      if (!(v <= lastval))
+      {
+        continue;
+      }
+      while (v <= edges[k])
+      {
+        --k;
+      }
+      while (v > edges[k + 1])
+      {
+        ++k;
+      }
+      ++bins[(j % HISTOGRAM_LANES) * m + k];
+    }
+  }
+}
+
+static int histogram_num_chunks(int n, int nthreads)
+{
+  int num = std::min(nthreads, n / HISTOGRAM_GRAIN);
+  return num < 1 ? 1 : num;
+}
+
+void histogram_minmax(const double* data, int n, double* minval, double* maxval, int nthreads)
+{
+  const int num_chunks = histogram_num_chunks(n, nthreads);
+  const int chunk = (n + num_chunks - 1) / num_chunks;
+  std::vector<double> mn(num_chunks);
+  std::vector<double> mx(num_chunks);
+  #pragma omp parallel for num_threads(num_chunks) schedule(static, 1)
+  for (int c = 0; c < num_chunks; ++c)
+  {
+    int begin = c * chunk;
+    int end = std::min(begin + chunk, n);
+    histogram_minmax_chunk(data + begin, end - begin, &mn[c], &mx[c]);
+  }
+  *minval = *std::min_element(mn.begin(), mn.end());
+  *maxval = *std::max_element(mx.begin(), mx.end());
+}
+
+void histogram_breaks(double minval, double maxval, int m, double* breaks)
+{
+  double by = (maxval - minval) / m;
+  breaks[0] = minval;
+  for (int i = 1; i < m; ++i)
+  {
+    breaks[i] = minval + i * by;
+  }
+  breaks[m] = maxval;
+}
+
+void histogram_counts(const double* data, int n, const double* breaks, int m, double* counts, int nthreads)
+{
+  const int num_chunks = histogram_num_chunks(n, nthreads);
+  const int chunk = (n + num_chunks - 1) / num_chunks;
+  const int size = HISTOGRAM_LANES * m;
+  std::vector<unsigned int> bins(num_chunks * size, 0);
+  #pragma omp parallel for num_threads(num_chunks) schedule(static, 1)
+  for (int c = 0; c < num_chunks; ++c)
+  {
+    int begin = c * chunk;
+    int end = std::min(begin + chunk, n);
+    histogram_counts_chunk(data + begin, end - begin, breaks, m, &bins[c * size]);
+  }
+  // merge the sub-histograms
+  for (int k = 0; k < m; ++k)
+  {
+    counts[k] = 0;
+  }
+  for (int l = 0; l < num_chunks * HISTOGRAM_LANES; ++l)
+  {
+    const unsigned int* sub = &bins[l * m];
+    for (int k = 0; k < m; ++k)
+    {
+      counts[k] += sub[k];
+    }
+  }
+}
+
+// histogram of data with intervalnumber bins of the same width between the
+// minimum and the maximum of data
+// nthreads: number of threads. the result does not depend on nthreads.
+// [[Rcpp::export]]
+Rcpp::List make_histogram(Rcpp::NumericVector data, int intervalnumber, int nthreads)
+{
+  int n = data.size();
+  double minval = NA_REAL;
+  double maxval = NA_REAL;
+  if (intervalnumber < 0)
+  {
+    Rcpp::Rcout << "Error: intervalnumber must be positive." << std::endl;
+    intervalnumber = 0;
+  }
+  if (nthreads < 1)
+  {
+    nthreads = 1;
+  }
+  Rcpp::NumericVector counts(intervalnumber);
+  Rcpp::NumericVector breaks(intervalnumber + 1);
+  if (n > 0 && intervalnumber > 0)
+  {
+    histogram_minmax(data.begin(), n, &minval, &maxval, nthreads);
+    histogram_breaks(minval, maxval, intervalnumber, breaks.begin());
+    histogram_counts(data.begin(), n, breaks.begin(), intervalnumber, counts.begin(), nthreads);
+  }
+  return Rcpp::List::create(Rcpp::Named("counts") = counts, Rcpp::Named("breaks") = breaks, Rcpp::Named("min") = minval, Rcpp::Named("max") = maxval);
+}
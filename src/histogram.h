@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2018, Shota Ochi <shotaochi1990@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGEREXTRA_HISTOGRAM_H
+#define IMAGEREXTRA_HISTOGRAM_H
+
+// The data are split into at most nthreads chunks of at least 65536 values,
+// and each chunk is processed by one thread. The results don't depend on nthreads.
+
+// minimum and maximum of data in one pass
+void histogram_minmax(const double* data, int n, double* minval, double* maxval, int nthreads);
+
+// the m + 1 values of seq(minval, maxval, length.out = m + 1) in R
+void histogram_breaks(double minval, double maxval, int m, double* breaks);
+
+// counts[k] is the number of the values v of data in the bin k, that is, the
+// first k such that v <= breaks[k + 1]. Values greater than breaks[m] are not counted.
+// This is the histogram the thresholding and equalization functions used to
+// make from the sorted image, made in one pass without sorting.
+// Each thread counts into its own bins, which are added up at the end.
+void histogram_counts(const double* data, int n, const double* breaks, int m, double* counts, int nthreads);
+
+#endif
@@ -17,49 +17,82 @@
  */
 
 #include <Rcpp.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "thresholding_objectives.h"
 
-// [[Rcpp::export]]
-Rcpp::NumericVector make_prob_otsu(Rcpp::NumericVector ordered, Rcpp::NumericVector bins, int intervalnumber, int width, int height)
+// the first index of the maximum of ICV
+int argmax_otsu(const double* ICV, int n)
 {
-  Rcpp::NumericVector out(intervalnumber);
-  int n = ordered.size();
-  int m = bins.size();
-  int count = 0;
-  for (int i = 0; i < n; ++i)
+  double maxICV = ICV[0];
+  int res = 0;
+  for (int i = 1; i < n; ++i)
   {
-    if (ordered[i] <= bins[count])
+    if (ICV[i] > maxICV)
     {
-      out[count] += 1;
-    } else {
-      while (ordered[i] > bins[count])
-      {
-        ++count;    
-      }
-      if (count >= intervalnumber || count >= m) 
-      {
-        break;
-      }
-      out[count] += 1;
+      maxICV = ICV[i];
+      res = i;
     }
   }
-  double size = (double)width * height;
-  for (int i = 0; i < intervalnumber; ++i) 
+  return res;
+}
+
+// cum_prob[i] and cum_moment[i] are the sums of prob and prob * bins over the bins before i.
+// They have n + 1 entries, and the first entries are 0.
+void make_cumulative_moments_otsu(const double* prob, const double* bins, int n, double* cum_prob, double* cum_moment)
+{
+  double omegak = 0.0;
+  double myuk = 0.0;
+  cum_prob[0] = 0.0;
+  cum_moment[0] = 0.0;
+  for (int i = 0; i < n; ++i)
   {
-    out[i] /= size;
+    omegak += prob[i];
+    myuk += prob[i] * bins[i];
+    cum_prob[i + 1] = omegak;
+    cum_moment[i + 1] = myuk;
   }
-  return out;
 }
 
-double calc_ICV_ostu(double omegak, double myuk, double myut)
+// Otsu's method restricted to the bins lo, ..., hi - 1 (hi - lo > 1) with the probabilities renormalized.
+// cum_prob and cum_moment are the prefix sums of prob and prob * bins (n + 1 entries, the first is 0).
+// With w_i and m_i the sums of prob and prob * bins over lo, ..., i, and W and M those over the whole range,
+// the interclass variance times W^2 is (M * w_i - m_i * W)^2 / (w_i * (W - w_i)), which has the same maximum.
+// work must have hi - lo doubles. Returns the index of the threshold in bins.
+int calc_threshold_otsu_range(const double* cum_prob, const double* cum_moment, int lo, int hi, double* work)
 {
-  if (omegak != 0 && omegak != 1) 
+  int n = hi - lo;
+  double P0 = cum_prob[lo];
+  double M0 = cum_moment[lo];
+  double W = cum_prob[hi] - P0;
+  double M = cum_moment[hi] - M0;
+  const double* P = cum_prob + lo + 1;
+  const double* S = cum_moment + lo + 1;
+  #pragma omp simd
+  for (int i = 0; i < n; ++i)
   {
-    return (myut * omegak - myuk) * (myut * omegak - myuk) / (omegak * (1 - omegak));
-  } else {
-    return -1;
+    double w = P[i] - P0;
+    double m = S[i] - M0;
+    double diff = M * w - m * W;
+    double denom = w * (W - w);
+    double invalid = denom == 0.0;
+    double ICV = diff * diff / (denom + invalid);
+    work[i] = ICV * (1 - invalid) - invalid;
   }
+  return lo + argmax_otsu(work, n);
 }
-  
+
+// Otsu's method on all the bins. The first maximum is returned.
+// work must have 3 * n + 2 doubles.
+int calc_threshold_otsu(const double* prob, const double* bins, int n, double* work)
+{
+  double* cum_prob = work;
+  double* cum_moment = work + n + 1;
+  make_cumulative_moments_otsu(prob, bins, n, cum_prob, cum_moment);
+  return calc_threshold_otsu_range(cum_prob, cum_moment, 0, n, work + 2 * n + 2);
+}
+
 // [[Rcpp::export]]
 double get_th_otsu(Rcpp::NumericVector prob_otsu, Rcpp::NumericVector bins)
 {
@@ -75,28 +108,244 @@ double get_th_otsu(Rcpp::NumericVector prob_otsu, Rcpp::NumericVector bins)
     Rcpp::Rcout << "lengths of prob_otsu and bins are not same." << std::endl;
     return 0;
   }
-    
-  double myut = 0.0;
-  for (int i = 0; i < n; ++i) 
+  std::vector<double> work(3 * n + 2);
+  return bins[calc_threshold_otsu(prob_otsu.begin(), bins.begin(), n, &work[0])];
+}
+
+// S^2 / P of the bins a, ..., b - 1, where P and S are the sums of prob and prob * bins. 0 if P is 0.
+double segment_otsu(const double* cum_prob, const double* cum_moment, int a, int b)
+{
+  double P = cum_prob[b] - cum_prob[a];
+  double S = cum_moment[b] - cum_moment[a];
+  double empty = P == 0.0;
+  return S * S / (P + empty) * (1 - empty);
+}
+
+// Iterative triclass thresholding on the histogram.
+// Each iteration splits the TBD region, the bins lo, ..., hi - 1, at the threshold of Otsu's method,
+// computes the means of the two classes from the prefix sums, and shrinks the TBD region to the bins
+// between the means. Thus an iteration takes O(n) time and the loop allocates nothing.
+// If repeatnum is positive, the threshold is computed repeatnum times. Otherwise the iteration stops
+// when the threshold moves less than stopval.
+// stopped is TRUE if the iteration ended because a class or the TBD region became empty.
+// [[Rcpp::export]]
+Rcpp::List threshold_triclass(Rcpp::NumericVector prob_otsu, Rcpp::NumericVector bins, double stopval, int repeatnum)
+{
+  int n = prob_otsu.size();
+  if (n < 2)
+  {
+    Rcpp::Rcout << "lengths of prob_otsu must be greater than 1." << std::endl;
+    return Rcpp::List::create();
+  }
+  if (n != bins.size())
+  {
+    Rcpp::Rcout << "lengths of prob_otsu and bins are not same." << std::endl;
+    return Rcpp::List::create();
+  }
+  std::vector<double> cum_prob(n + 1);
+  std::vector<double> cum_moment(n + 1);
+  std::vector<double> work(n);
+  make_cumulative_moments_otsu(prob_otsu.begin(), bins.begin(), n, &cum_prob[0], &cum_moment[0]);
+
+  int lo = 0;
+  int hi = n;
+  int th = calc_threshold_otsu_range(&cum_prob[0], &cum_moment[0], lo, hi, &work[0]);
+  int num_iter = 1;
+  bool stopped = false;
+  // the first iteration is always done
+  double thresval_pre = bins[th] + 2 * stopval;
+  double tol = 1e-3 * (bins[n - 1] - bins[0]) / (n - 1);
+  while (repeatnum <= 0 || num_iter < repeatnum)
   {
-    myut += prob_otsu[i] * bins[i];
+    // the background is lo, ..., th and the foreground is th + 1, ..., hi - 1
+    double myu0 = (cum_moment[th + 1] - cum_moment[lo]) / (cum_prob[th + 1] - cum_prob[lo]);
+    double myu1 = (cum_moment[hi] - cum_moment[th + 1]) / (cum_prob[hi] - cum_prob[th + 1]);
+    if (std::isnan(myu0) || std::isnan(myu1))
+    {
+      stopped = true;
+      break;
+    }
+    // the means differ from the exact ones by the rounding errors of the prefix sums.
+    // tol keeps a bin whose center is a mean, e.g. the only nonempty bin of a class.
+    int lo_next = std::lower_bound(bins.begin() + lo, bins.begin() + hi, myu0 - tol) - bins.begin();
+    int hi_next = std::upper_bound(bins.begin() + lo, bins.begin() + hi, myu1 + tol) - bins.begin();
+    if (hi_next - lo_next < 2 || cum_prob[hi_next] - cum_prob[lo_next] == 0)
+    {
+      stopped = true;
+      break;
+    }
+    lo = lo_next;
+    hi = hi_next;
+    th = calc_threshold_otsu_range(&cum_prob[0], &cum_moment[0], lo, hi, &work[0]);
+    ++num_iter;
+    if (repeatnum <= 0 && std::fabs(bins[th] - thresval_pre) < stopval)
+    {
+      break;
+    }
+    thresval_pre = bins[th];
   }
+  return Rcpp::List::create(Rcpp::Named("threshold") = bins[th], Rcpp::Named("num_iter") = num_iter, Rcpp::Named("stopped") = stopped);
+}
 
-  double omegak = prob_otsu[0];
-  double myuk = prob_otsu[0] * bins[0];
-  double ICV = calc_ICV_ostu(omegak, myuk, myut);
-  double maxICV = ICV;
-  double threshold = bins[0];
-  for(int i = 1; i < n; ++i)
-  {
-    omegak += prob_otsu[i];
-    myuk += prob_otsu[i] * bins[i];
-    ICV = calc_ICV_ostu(omegak, myuk, myut);
-    if (ICV > maxICV) 
+// weights, means, and variances of the k + 1 classes split by the threshold bins idx[0] < ... < idx[k - 1].
+// the class j has the bins idx[j - 1] + 1, ..., idx[j]. the mean and the variance of an empty class are NaN.
+void calc_class_stats_otsu(const double* prob, const double* bins, int n, const int* idx, int k, double* weights, double* means, double* variances)
+{
+  std::vector<double> moment2(k + 1, 0.0);
+  for (int j = 0; j <= k; ++j)
+  {
+    weights[j] = 0.0;
+    means[j] = 0.0;
+  }
+  double total = 0.0;
+  int j = 0;
+  for (int i = 0; i < n; ++i)
+  {
+    if (j < k && i > idx[j])
+    {
+      ++j;
+    }
+    weights[j] += prob[i];
+    means[j] += prob[i] * bins[i];
+    moment2[j] += prob[i] * bins[i] * bins[i];
+    total += prob[i];
+  }
+  for (j = 0; j <= k; ++j)
+  {
+    means[j] /= weights[j];
+    variances[j] = std::max(0.0, moment2[j] / weights[j] - means[j] * means[j]);
+    if (weights[j] == 0)
     {
-      maxICV = ICV;
-      threshold = bins[i];
+      variances[j] = NAN;
     }
+    weights[j] /= total;
   }
-  return threshold;
-}
\ No newline at end of file
+}
+
+// Otsu's method with the interclass variance of every threshold.
+// variance[i] is the interclass variance of the threshold bins[i], and it is 0 if a class is empty.
+// Returns the index of the threshold (1-based), variance, and the weights, means, and variances of the two classes.
+// [[Rcpp::export]]
+Rcpp::List otsu_stats(Rcpp::NumericVector prob_otsu, Rcpp::NumericVector bins)
+{
+  int n = prob_otsu.size();
+  if (n < 2)
+  {
+    Rcpp::Rcout << "lengths of prob_otsu must be greater than 1." << std::endl;
+    return Rcpp::List::create();
+  }
+  if (n != bins.size())
+  {
+    Rcpp::Rcout << "lengths of prob_otsu and bins are not same." << std::endl;
+    return Rcpp::List::create();
+  }
+  std::vector<double> cum_prob(n + 1);
+  std::vector<double> cum_moment(n + 1);
+  make_cumulative_moments_otsu(prob_otsu.begin(), bins.begin(), n, &cum_prob[0], &cum_moment[0]);
+  Rcpp::NumericVector variance(n);
+  int th = calc_threshold_otsu_range(&cum_prob[0], &cum_moment[0], 0, n, variance.begin());
+  double W2 = cum_prob[n] * cum_prob[n];
+  for (int i = 0; i < n; ++i)
+  {
+    variance[i] = std::max(0.0, variance[i]) / W2;
+  }
+  Rcpp::NumericVector weights(2);
+  Rcpp::NumericVector means(2);
+  Rcpp::NumericVector variances(2);
+  calc_class_stats_otsu(prob_otsu.begin(), bins.begin(), n, &th, 1, weights.begin(), means.begin(), variances.begin());
+  return Rcpp::List::create(Rcpp::Named("index") = th + 1, Rcpp::Named("variance") = variance,
+                            Rcpp::Named("weights") = weights, Rcpp::Named("means") = means, Rcpp::Named("variances") = variances);
+}
+
+// Multilevel Otsu's method by dynamic programming on lookup tables.
+// The interclass variance of the classes C_0, ..., C_k is sum_j S_j^2 / P_j - myut^2, where P_j and S_j are
+// the sums of prob and prob * bins over C_j. S_j^2 / P_j of any range of bins is computed in O(1) by the prefix sums.
+// best[j * n + t] is the maximum of sum S^2 / P of the classes up to C_j when the threshold j is t,
+// and from[j * n + t] is the threshold j - 1 giving it. Thus the thresholds are found in O(k n^2) time.
+// Ties are broken in favor of the smallest thresholds.
+// Returns the indices of the thresholds (1-based), the interclass variance, and the weights, means, and variances of the classes.
+// [[Rcpp::export]]
+Rcpp::List otsu_multilevel(Rcpp::NumericVector prob_otsu, Rcpp::NumericVector bins, int n_thres)
+{
+  int n = prob_otsu.size();
+  if (n != bins.size())
+  {
+    Rcpp::Rcout << "lengths of prob_otsu and bins are not same." << std::endl;
+    return Rcpp::List::create();
+  }
+  if (n_thres < 1 || n_thres > n - 1)
+  {
+    Rcpp::Rcout << "Error: n_thres must be in [1, length of prob_otsu - 1]." << std::endl;
+    return Rcpp::List::create();
+  }
+  std::vector<double> cum_prob(n + 1);
+  std::vector<double> cum_moment(n + 1);
+  make_cumulative_moments_otsu(prob_otsu.begin(), bins.begin(), n, &cum_prob[0], &cum_moment[0]);
+  std::vector<double> best(n_thres * n, -HUGE_VAL);
+  std::vector<int> from(n_thres * n, -1);
+  std::vector<double> segment(n);
+
+  // the class C_0 is the bins 0, ..., t
+  for (int t = 0; t < n; ++t)
+  {
+    best[t] = segment_otsu(&cum_prob[0], &cum_moment[0], 0, t + 1);
+  }
+  for (int t = 1; t < n; ++t)
+  {
+    // the classes s + 1, ..., t for s < t
+    #pragma omp simd
+    for (int s = 0; s < t; ++s)
+    {
+      segment[s] = segment_otsu(&cum_prob[0], &cum_moment[0], s + 1, t + 1);
+    }
+    int jmax = std::min(n_thres - 1, t);
+    for (int j = 1; j <= jmax; ++j)
+    {
+      double* best_j = &best[j * n];
+      const double* best_prev = &best[(j - 1) * n];
+      for (int s = j - 1; s < t; ++s)
+      {
+        double val = best_prev[s] + segment[s];
+        if (val > best_j[t])
+        {
+          best_j[t] = val;
+          from[j * n + t] = s;
+        }
+      }
+    }
+  }
+
+  // the last class is the bins t + 1, ..., n - 1
+  int last = -1;
+  double bestval = -HUGE_VAL;
+  for (int t = n_thres - 1; t < n - 1; ++t)
+  {
+    double val = best[(n_thres - 1) * n + t] + segment_otsu(&cum_prob[0], &cum_moment[0], t + 1, n);
+    if (val > bestval)
+    {
+      bestval = val;
+      last = t;
+    }
+  }
+  std::vector<int> idx(n_thres);
+  idx[n_thres - 1] = last;
+  for (int j = n_thres - 1; j > 0; --j)
+  {
+    idx[j - 1] = from[j * n + idx[j]];
+  }
+
+  Rcpp::IntegerVector index(n_thres);
+  for (int j = 0; j < n_thres; ++j)
+  {
+    index[j] = idx[j] + 1;
+  }
+  double W = cum_prob[n];
+  double myut = cum_moment[n] / W;
+  double variance = std::max(0.0, bestval / W - myut * myut);
+  Rcpp::NumericVector weights(n_thres + 1);
+  Rcpp::NumericVector means(n_thres + 1);
+  Rcpp::NumericVector variances(n_thres + 1);
+  calc_class_stats_otsu(prob_otsu.begin(), bins.begin(), n, &idx[0], n_thres, weights.begin(), means.begin(), variances.begin());
+  return Rcpp::List::create(Rcpp::Named("index") = index, Rcpp::Named("variance") = variance,
+                            Rcpp::Named("weights") = weights, Rcpp::Named("means") = means, Rcpp::Named("variances") = variances);
+}
@@ -19,65 +19,389 @@
 //$ @references Faisal Shafait, Daniel Keysers, Thomas M. Breuel, "Efficient implementation of local adaptive thresholding techniques using integral images", Proc. SPIE 6815, Document Recognition and Retrieval XV, 681510 (28 January 2008)
 
 #include <Rcpp.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
 
-Rcpp::NumericMatrix calc_integralsum(Rcpp::NumericMatrix mat) {
+// Integral images of the pixels and of their squares.
+// table has 2 * (nrow + 1) * (ncol + 1) doubles. table[2 * (r + c * (nrow + 1))] is the sum of mat(i, j)
+// for i < r and j < c, and the next entry is the sum of mat(i, j)^2. The row 0 and the column 0 are 0,
+// so that the sum over any window is 4 lookups without the special cases of the edges.
+// The sum and the sum of squares of the same corner are next to each other, and they are read by one cache line.
+// The table is built by two separable passes: the prefix sums down each column, which are independent of
+// each other, and then the carries across the columns, which are independent for each block of rows.
+// Each entry is the sum of the same terms in the same order as in one pass, so the table doesn't depend on nthreads.
+// With one thread, the carries are added in the first pass, which saves a pass over the table.
+void make_integral_table(const double* mat, int nrow, int ncol, double* table, int nthreads) {
+  size_t stride = 2 * (size_t)(nrow + 1);
+  for (size_t r = 0; r < stride; ++r) {
+    table[r] = 0.0;
+  }
+  bool fused = nthreads <= 1;
+  #pragma omp parallel for num_threads(nthreads) schedule(static)
+  for (int c = 0; c < ncol; ++c) {
+    const double* col = mat + (size_t)c * nrow;
+    const double* prev = table + (size_t)c * stride;
+    double* cur = table + (size_t)(c + 1) * stride;
+    double sum = 0.0;
+    double sum_squared = 0.0;
+    cur[0] = 0.0;
+    cur[1] = 0.0;
+    if (fused) {
+      for (int r = 0; r < nrow; ++r) {
+        sum += col[r];
+        sum_squared += col[r] * col[r];
+        cur[2 * r + 2] = prev[2 * r + 2] + sum;
+        cur[2 * r + 3] = prev[2 * r + 3] + sum_squared;
+      }
+    } else {
+      for (int r = 0; r < nrow; ++r) {
+        sum += col[r];
+        sum_squared += col[r] * col[r];
+        cur[2 * r + 2] = sum;
+        cur[2 * r + 3] = sum_squared;
+      }
+    }
+  }
+  if (fused) {
+    return;
+  }
+  // blocks of rows of at least 4 KB so that the threads don't share cache lines
+  int num_blocks = std::max(1, std::min(nthreads, (int)(stride / 512)));
+  size_t block = ((stride + num_blocks - 1) / num_blocks + 7) / 8 * 8;
+  #pragma omp parallel for num_threads(num_blocks) schedule(static, 1)
+  for (int b = 0; b < num_blocks; ++b) {
+    size_t begin = std::min(b * block, stride);
+    size_t end = std::min(begin + block, stride);
+    for (int c = 1; c < ncol; ++c) {
+      const double* prev = table + (size_t)c * stride;
+      double* cur = table + (size_t)(c + 1) * stride;
+      #pragma omp simd
+      for (size_t r = begin; r < end; ++r) {
+        cur[r] += prev[r];
+      }
+    }
+  }
+}
+
+// Binarizes a line of n pixels by the local thresholds.
+// sum and sum_squared have n + 2 * winhalf + 1 entries. sum[winhalf + t] is the sum of the window sums
+// across the line over the pixels before t, and it is padded with the values of t = 0 and t = n, so the
+// window of the pixel i clamped to the line is read at i and i + 2 * winhalf + 1 without branches.
+// count[i] is the number of the pixels of the window of i in the line, and inv_count_across is the inverse
+// of the number of the lines in the window.
+void threshold_adaptive_line(const double* line, int n, int winhalf, const double* sum, const double* sum_squared,
+                             const double* count, double inv_count_across, double k, double maxsd, double* res) {
+  int winfull = 2 * winhalf + 1;
+  double k_maxsd = k / maxsd;
+  #pragma omp simd
+  for (int i = 0; i < n; ++i) {
+    double inv_count = inv_count_across / count[i];
+    double mean_local = (sum[i + winfull] - sum[i]) * inv_count;
+    double sd_local = sqrt((sum_squared[i + winfull] - sum_squared[i]) * inv_count - mean_local * mean_local);
+    double threshold_local = mean_local * (1 - k + k_maxsd * sd_local);
+    // 1 unless the pixel is smaller than or equal to the threshold, as 1 is also given where threshold_local is NaN
+    res[i] = 1.0 - (line[i] <= threshold_local);
+  }
+}
+
+// count[i] is the number of the pixels of the window of i clamped to a line of n pixels
+void make_window_count(int n, int winhalf, double* count) {
+  for (int i = 0; i < n; ++i) {
+    count[i] = std::min(i + winhalf + 1, n) - std::max(i - winhalf, 0);
+  }
+}
+
+// pads sum[winhalf], ..., sum[winhalf + n] with winhalf zeros on the left and winhalf copies of sum[winhalf + n] on the right
+void pad_window_sums(int n, int winhalf, double* sum) {
+  for (int t = 0; t < winhalf; ++t) {
+    sum[t] = 0.0;
+    sum[n + winhalf + 1 + t] = sum[n + winhalf];
+  }
+}
+
+// [[Rcpp::export]]
+Rcpp::NumericMatrix threshold_adaptive(Rcpp::NumericMatrix mat, double k, int windowsize, double maxsd, int nthreads) {
   int nrow = mat.nrow();
   int ncol = mat.ncol();
   Rcpp::NumericMatrix res(nrow, ncol);
+  int winhalf = windowsize / 2;
 
-  res(0,0) = mat(0,0);
-  for (int i = 1; i < nrow; ++i) {
-    res(i,0) = mat(i,0) + res(i-1,0);
+  // sanity check for windowsize
+  if (windowsize < 1) {
+    Rcpp::Rcout << "Error: window size must be positive." << std::endl;
+    return res;
+  }
+  // sanity check for windowsize and matsize
+  if (nrow < windowsize || ncol < windowsize) {
+    Rcpp::Rcout << "Error: windowsize is too large." << std::endl;
+    return res;
   }
-  for (int j = 1; j < ncol; ++j) {
-    res(0,j) = mat(0,j) + res(0,j-1);
+  // sanity check for maxsd
+  if (maxsd == 0.0) {
+    Rcpp::Rcout << "Error: maxsd is 0." << std::endl;
+    return res;
   }
-  for (int i = 1; i < nrow; ++i) {
-    for (int j = 1; j < ncol; ++j) {
-      res(i,j) = mat(i,j) + res(i-1,j) + res(i,j-1) - res(i-1,j-1);
+  // sanity check for k
+  if (k < 0.0 || k > 1.0) {
+    Rcpp::Rcout << "Error: k is out of range. k must be in [0,1]." << std::endl;
+    return res;
+  }
+
+  if (nthreads < 1) {
+    nthreads = 1;
+  }
+
+  std::vector<double> table(2 * (size_t)(nrow + 1) * (ncol + 1));
+  make_integral_table(mat.begin(), nrow, ncol, &table[0], nthreads);
+  size_t stride = 2 * (size_t)(nrow + 1);
+
+  // The window of (i, j) is the rows [i - winhalf, i + winhalf] and the columns [j - winhalf, j + winhalf]
+  // clamped to the image. The window sums of the column j are read from the two columns of table.
+  // The columns are binarized independently, each thread with its own buffers of the window sums.
+  int n_padded = nrow + 2 * winhalf + 1;
+  std::vector<double> rowcount(nrow);
+  make_window_count(nrow, winhalf, &rowcount[0]);
+  const double* pmat = mat.begin();
+  double* pres = res.begin();
+  #pragma omp parallel num_threads(nthreads)
+  {
+    std::vector<double> column_sum(n_padded);
+    std::vector<double> column_sum_squared(n_padded);
+    double* cs = &column_sum[0];
+    double* cs2 = &column_sum_squared[0];
+    #pragma omp for schedule(static)
+    for (int j = 0; j < ncol; ++j) {
+      int c0 = std::max(j - winhalf, 0);
+      int c1 = std::min(j + winhalf + 1, ncol);
+      const double* left = &table[c0 * stride];
+      const double* right = &table[c1 * stride];
+      #pragma omp simd
+      for (int r = 0; r <= nrow; ++r) {
+        cs[winhalf + r] = right[2 * r] - left[2 * r];
+        cs2[winhalf + r] = right[2 * r + 1] - left[2 * r + 1];
+      }
+      pad_window_sums(nrow, winhalf, cs);
+      pad_window_sums(nrow, winhalf, cs2);
+      threshold_adaptive_line(pmat + (size_t)j * nrow, nrow, winhalf, cs, cs2, &rowcount[0], 1.0 / (c1 - c0), k, maxsd,
+                              pres + (size_t)j * nrow);
     }
   }
   return res;
 }
 
-Rcpp::NumericMatrix calc_integralsum_squared(Rcpp::NumericMatrix mat) {
+// Local means and standard deviations of a line of n pixels, read from the window sums as in threshold_adaptive_line
+void mean_sd_adaptive_line(int n, int winhalf, const double* sum, const double* sum_squared, const double* count,
+                           double inv_count_across, double* mean, double* sd) {
+  int winfull = 2 * winhalf + 1;
+  #pragma omp simd
+  for (int i = 0; i < n; ++i) {
+    double inv_count = inv_count_across / count[i];
+    double mean_local = (sum[i + winfull] - sum[i]) * inv_count;
+    mean[i] = mean_local;
+    sd[i] = sqrt((sum_squared[i + winfull] - sum_squared[i]) * inv_count - mean_local * mean_local);
+  }
+}
+
+// Local adaptive thresholding with several window sizes and several k at once.
+// The integral table is built once, and each window size costs one pass of lookups, the local means and
+// standard deviations being shared by all the k. Each binarization is the same as that of threshold_adaptive
+// with the same window size and k. The binarizations are given for each window size and for each k, k
+// varying fastest. If votes is true, only the number of the binarizations giving 1 is given for each pixel.
+// [[Rcpp::export]]
+Rcpp::List threshold_adaptive_multi(Rcpp::NumericMatrix mat, Rcpp::NumericVector k, Rcpp::IntegerVector windowsize, double maxsd,
+                                    bool votes, int nthreads) {
   int nrow = mat.nrow();
   int ncol = mat.ncol();
-  Rcpp::NumericMatrix mat_squared(nrow, ncol);
-  Rcpp::NumericMatrix res(nrow, ncol);
+  int n_k = k.size();
+  int n_windowsize = windowsize.size();
+  int maxwinhalf = 0;
 
-  for (int i = 0; i < nrow; ++i) {
-    for (int j = 0; j < ncol; ++j) {
-      mat_squared(i,j) = mat(i,j) * mat(i,j);
+  // sanity check for k and windowsize
+  if (n_k == 0 || n_windowsize == 0) {
+    Rcpp::Rcout << "Error: k and windowsize must not be empty." << std::endl;
+    return Rcpp::List::create();
+  }
+  // sanity check for windowsize and matsize
+  for (int w = 0; w < n_windowsize; ++w) {
+    if (windowsize[w] < 1) {
+      Rcpp::Rcout << "Error: window size must be positive." << std::endl;
+      return Rcpp::List::create();
+    }
+    if (nrow < windowsize[w] || ncol < windowsize[w]) {
+      Rcpp::Rcout << "Error: windowsize is too large." << std::endl;
+      return Rcpp::List::create();
     }
+    maxwinhalf = std::max(maxwinhalf, windowsize[w] / 2);
+  }
+  // sanity check for maxsd
+  if (maxsd == 0.0) {
+    Rcpp::Rcout << "Error: maxsd is 0." << std::endl;
+    return Rcpp::List::create();
+  }
+  // sanity check for k
+  for (int l = 0; l < n_k; ++l) {
+    if (k[l] < 0.0 || k[l] > 1.0) {
+      Rcpp::Rcout << "Error: k is out of range. k must be in [0,1]." << std::endl;
+      return Rcpp::List::create();
+    }
+  }
+  if (nthreads < 1) {
+    nthreads = 1;
   }
 
-  res(0,0) = mat_squared(0,0);
-  for (int i = 1; i < nrow; ++i) {
-    res(i,0) = mat_squared(i,0) + res(i-1,0);
+  int n_res = votes ? 1 : n_k * n_windowsize;
+  Rcpp::List res(n_res);
+  std::vector<double*> pres(n_res);
+  for (int m = 0; m < n_res; ++m) {
+    Rcpp::NumericMatrix res_m(nrow, ncol);
+    res[m] = res_m;
+    pres[m] = res_m.begin();
   }
-  for (int j = 1; j < ncol; ++j) {
-    res(0,j) = mat_squared(0,j) + res(0,j-1);
+
+  std::vector<double> table(2 * (size_t)(nrow + 1) * (ncol + 1));
+  make_integral_table(mat.begin(), nrow, ncol, &table[0], nthreads);
+  size_t stride = 2 * (size_t)(nrow + 1);
+  std::vector<double> rowcount((size_t)n_windowsize * nrow);
+  for (int w = 0; w < n_windowsize; ++w) {
+    make_window_count(nrow, windowsize[w] / 2, &rowcount[(size_t)w * nrow]);
   }
-  for (int i = 1; i < nrow; ++i) {
-    for (int j = 1; j < ncol; ++j) {
-      res(i,j) = mat_squared(i,j) + res(i-1,j) + res(i,j-1) - res(i-1,j-1);
+
+  int n_padded = nrow + 2 * maxwinhalf + 1;
+  const double* pmat = mat.begin();
+  #pragma omp parallel num_threads(nthreads)
+  {
+    std::vector<double> column_sum(n_padded);
+    std::vector<double> column_sum_squared(n_padded);
+    std::vector<double> mean(nrow);
+    std::vector<double> sd(nrow);
+    double* cs = &column_sum[0];
+    double* cs2 = &column_sum_squared[0];
+    #pragma omp for schedule(static)
+    for (int j = 0; j < ncol; ++j) {
+      const double* line = pmat + (size_t)j * nrow;
+      for (int w = 0; w < n_windowsize; ++w) {
+        int winhalf = windowsize[w] / 2;
+        int c0 = std::max(j - winhalf, 0);
+        int c1 = std::min(j + winhalf + 1, ncol);
+        const double* left = &table[c0 * stride];
+        const double* right = &table[c1 * stride];
+        #pragma omp simd
+        for (int r = 0; r <= nrow; ++r) {
+          cs[winhalf + r] = right[2 * r] - left[2 * r];
+          cs2[winhalf + r] = right[2 * r + 1] - left[2 * r + 1];
+        }
+        pad_window_sums(nrow, winhalf, cs);
+        pad_window_sums(nrow, winhalf, cs2);
+        mean_sd_adaptive_line(nrow, winhalf, cs, cs2, &rowcount[(size_t)w * nrow], 1.0 / (c1 - c0), &mean[0], &sd[0]);
+        for (int l = 0; l < n_k; ++l) {
+          double kl = k[l];
+          double k_maxsd = kl / maxsd;
+          const double* pmean = &mean[0];
+          const double* psd = &sd[0];
+          double* out = votes ? pres[0] + (size_t)j * nrow : pres[w * n_k + l] + (size_t)j * nrow;
+          // 1 unless the pixel is smaller than or equal to the threshold, as in threshold_adaptive_line
+          if (votes) {
+            #pragma omp simd
+            for (int i = 0; i < nrow; ++i) {
+              out[i] += 1.0 - (line[i] <= pmean[i] * (1 - kl + k_maxsd * psd[i]));
+            }
+          } else {
+            #pragma omp simd
+            for (int i = 0; i < nrow; ++i) {
+              out[i] = 1.0 - (line[i] <= pmean[i] * (1 - kl + k_maxsd * psd[i]));
+            }
+          }
+        }
+      }
     }
   }
   return res;
 }
 
+// Robust local adaptive thresholding for large images and high dynamic range.
+// The integral table of threshold_adaptive grows with the image, and the variance E[x^2] - E[x]^2 read from
+// it loses all its digits when the sums are much larger than the window sums, e.g. on 16-bit images of
+// hundreds of megapixels. Here the pixels are shifted by offset, an integer near the mean of the image, and
+// the window sums are running sums over the window only, so no sum is larger than windowsize^2 times the
+// largest squared shifted pixel, and sums of integer pixels are exact. The running sums are recomputed from
+// the pixels every ADAPTIVE_RESYNC steps so that the rounding errors of non-integer pixels don't accumulate,
+// and the variance is clamped at 0. The cost is still O(1) per pixel.
+// The resynchronizations are at the multiples of ADAPTIVE_RESYNC, so the result doesn't depend on nthreads.
+#define ADAPTIVE_RESYNC 64
+
+// an integer near the mean of the n pixels, 0 if the mean is not finite
+double offset_adaptive_robust(const double* mat, size_t n) {
+  double sum = 0.0;
+  double compensation = 0.0;
+  for (size_t i = 0; i < n; ++i) {
+    double y = mat[i] - compensation;
+    double t = sum + y;
+    compensation = (t - sum) - y;
+    sum = t;
+  }
+  double mean = sum / n;
+  return std::isfinite(mean) ? std::floor(mean) : 0.0;
+}
+
+// sum[r] and sum_squared[r] are the sums of the shifted pixels of the row r over the columns [c0, c1)
+void sum_columns_adaptive_robust(const double* mat, int nrow, int c0, int c1, double offset, double* sum, double* sum_squared) {
+  for (int r = 0; r < nrow; ++r) {
+    sum[r] = 0.0;
+    sum_squared[r] = 0.0;
+  }
+  for (int c = c0; c < c1; ++c) {
+    const double* col = mat + (size_t)c * nrow;
+    #pragma omp simd
+    for (int r = 0; r < nrow; ++r) {
+      double x = col[r] - offset;
+      sum[r] += x;
+      sum_squared[r] += x * x;
+    }
+  }
+}
+
+// binarizes the column j by the window sums across the columns sum and sum_squared, sliding the window along the column
+void threshold_adaptive_robust_line(const double* line, int n, int winhalf, const double* sum, const double* sum_squared,
+                                    const double* count, double inv_count_across, double k, double maxsd, double offset, double* res) {
+  double k_maxsd = k / maxsd;
+  double s = 0.0;
+  double s2 = 0.0;
+  for (int i = 0; i < n; ++i) {
+    int lo = std::max(i - winhalf, 0);
+    int hi = std::min(i + winhalf + 1, n);
+    if (i % ADAPTIVE_RESYNC == 0) {
+      s = 0.0;
+      s2 = 0.0;
+      for (int t = lo; t < hi; ++t) {
+        s += sum[t];
+        s2 += sum_squared[t];
+      }
+    } else {
+      if (i + winhalf < n) {
+        s += sum[i + winhalf];
+        s2 += sum_squared[i + winhalf];
+      }
+      if (i - winhalf - 1 >= 0) {
+        s -= sum[i - winhalf - 1];
+        s2 -= sum_squared[i - winhalf - 1];
+      }
+    }
+    double inv_count = inv_count_across / count[i];
+    double mean_shifted = s * inv_count;
+    double var_local = std::max(s2 * inv_count - mean_shifted * mean_shifted, 0.0);
+    double mean_local = mean_shifted + offset;
+    double threshold_local = mean_local * (1 - k + k_maxsd * sqrt(var_local));
+    res[i] = 1.0 - (line[i] <= threshold_local);
+  }
+}
+
 // [[Rcpp::export]]
-Rcpp::NumericMatrix threshold_adaptive(Rcpp::NumericMatrix mat, double k, int windowsize, double maxsd) {
+Rcpp::NumericMatrix threshold_adaptive_robust(Rcpp::NumericMatrix mat, double k, int windowsize, double maxsd, int nthreads) {
   int nrow = mat.nrow();
   int ncol = mat.ncol();
   Rcpp::NumericMatrix res(nrow, ncol);
-  Rcpp::NumericMatrix integralsum = calc_integralsum(mat);
-  Rcpp::NumericMatrix integralsum_squared = calc_integralsum_squared(mat);
   int winhalf = windowsize / 2;
-  int winsize_squared = windowsize * windowsize;
-  int nrow_center = nrow - windowsize;
-  int ncol_center = ncol - windowsize;
 
   // sanity check for windowsize
   if (windowsize < 1) {
@@ -99,131 +423,190 @@ Rcpp::NumericMatrix threshold_adaptive(Rcpp::NumericMatrix mat, double k, int wi
     Rcpp::Rcout << "Error: k is out of range. k must be in [0,1]." << std::endl;
     return res;
   }
-  
-  for (int i = 0; i < winhalf; ++i) {
-    for (int j = 0; j < winhalf; ++j) {
-      int temp_winsize = (winhalf + i + 1) * (winhalf + j + 1);
-      double mean_local = integralsum(i+winhalf,j+winhalf) / temp_winsize;
-      double sd_local = sqrt(integralsum_squared(i+winhalf,j+winhalf) / temp_winsize - mean_local * mean_local);
-      double threshold_local  = mean_local * (1 + k * (sd_local / maxsd - 1));
-      if (mat(i,j) <= threshold_local) {
-        res(i,j) = 0;
-      } else {
-        res(i,j) = 1;
-      }
-    }
+  if (nthreads < 1) {
+    nthreads = 1;
   }
 
-  for (int i = winhalf; i < nrow_center; ++i) {
-    for (int j =0; j < winhalf; ++j) {
-      int temp_winsize = windowsize * (winhalf + j + 1);
-      double mean_local = (integralsum(i+winhalf,j+winhalf) - integralsum(i-winhalf,j+winhalf)) / temp_winsize;
-      double sd_local = sqrt((integralsum_squared(i+winhalf,j+winhalf) - integralsum_squared(i-winhalf,j+winhalf)) / temp_winsize - mean_local * mean_local);
-      double threshold_local  = mean_local * (1 + k * (sd_local / maxsd - 1));
-      if (mat(i,j) <= threshold_local) {
-        res(i,j) = 0;
-      } else {
-        res(i,j) = 1;
-      }
-    }
-  }
+  const double* pmat = mat.begin();
+  double* pres = res.begin();
+  double offset = offset_adaptive_robust(pmat, (size_t)nrow * ncol);
+  std::vector<double> rowcount(nrow);
+  make_window_count(nrow, winhalf, &rowcount[0]);
 
-  for (int i = nrow_center; i < nrow; ++i) {
-    for (int j = 0; j < winhalf; ++j) {
-      int temp_winsize = (winhalf + nrow - i) * (winhalf + j + 1);
-      double mean_local = (integralsum(nrow-1,j+winhalf) - integralsum(i-winhalf,j+winhalf)) / temp_winsize;
-      double sd_local = sqrt((integralsum_squared(nrow-1,j+winhalf) - integralsum_squared(i-winhalf,j+winhalf)) / temp_winsize - mean_local * mean_local);
-      double threshold_local = mean_local * (1 + k * (sd_local / maxsd - 1));
-      if (mat(i,j) <= threshold_local) {
-        res(i,j) = 0;
-      } else {
-        res(i,j) = 1;
+  // The columns are split into blocks of ADAPTIVE_RESYNC columns. Each block starts from the exact sums,
+  // and the window across the columns slides to the next column by adding a column and removing another.
+  int num_blocks = (ncol + ADAPTIVE_RESYNC - 1) / ADAPTIVE_RESYNC;
+  #pragma omp parallel num_threads(std::min(nthreads, num_blocks))
+  {
+    std::vector<double> column_sum(nrow);
+    std::vector<double> column_sum_squared(nrow);
+    double* cs = &column_sum[0];
+    double* cs2 = &column_sum_squared[0];
+    #pragma omp for schedule(static)
+    for (int b = 0; b < num_blocks; ++b) {
+      int j_begin = b * ADAPTIVE_RESYNC;
+      int j_end = std::min(j_begin + ADAPTIVE_RESYNC, ncol);
+      for (int j = j_begin; j < j_end; ++j) {
+        int c0 = std::max(j - winhalf, 0);
+        int c1 = std::min(j + winhalf + 1, ncol);
+        if (j == j_begin) {
+          sum_columns_adaptive_robust(pmat, nrow, c0, c1, offset, cs, cs2);
+        } else {
+          if (j + winhalf < ncol) {
+            const double* col = pmat + (size_t)(j + winhalf) * nrow;
+            #pragma omp simd
+            for (int r = 0; r < nrow; ++r) {
+              double x = col[r] - offset;
+              cs[r] += x;
+              cs2[r] += x * x;
+            }
+          }
+          if (j - winhalf - 1 >= 0) {
+            const double* col = pmat + (size_t)(j - winhalf - 1) * nrow;
+            #pragma omp simd
+            for (int r = 0; r < nrow; ++r) {
+              double x = col[r] - offset;
+              cs[r] -= x;
+              cs2[r] -= x * x;
+            }
+          }
+        }
+        threshold_adaptive_robust_line(pmat + (size_t)j * nrow, nrow, winhalf, cs, cs2, &rowcount[0], 1.0 / (c1 - c0), k, maxsd,
+                                       offset, pres + (size_t)j * nrow);
       }
     }
   }
+  return res;
+}
 
-  for (int i = 0; i < winhalf; ++i) {
-    for (int j = winhalf; j < ncol_center; ++j) {
-      int temp_winsize = (winhalf + i + 1) * windowsize;
-      double mean_local = (integralsum(i+winhalf,j+winhalf) - integralsum(i+winhalf,j-winhalf)) / temp_winsize;
-      double sd_local = sqrt((integralsum_squared(i+winhalf,j+winhalf) - integralsum_squared(i+winhalf,j-winhalf)) / temp_winsize - mean_local * mean_local);
-      double threshold_local = mean_local * (1 + k * (sd_local / maxsd - 1));
-      if (mat(i,j) <= threshold_local) {
-        res(i,j) = 0;
-      } else {
-        res(i,j) = 1;
-      }
-    }
-  }
+// Streaming local adaptive thresholding.
+// The image is given line by line, a line being a column of the matrix of threshold_adaptive, and the
+// binarized lines are returned as soon as the lines of their windows have been given.
+// Only the last 2 * winhalf + 1 lines and the sums over them are kept, so the memory is
+// O(width * windowsize) whatever the height is. The result is the same as that of threshold_adaptive
+// up to the rounding errors of the running sums, and exactly the same for pixels of integer values.
+struct adaptive_stream {
+  int width;
+  int winhalf;
+  double k;
+  double maxsd;
+  int n_in;  // number of the lines given
+  int n_out; // number of the lines returned
+  int lo;    // first line in band_sum
+  std::vector<double> band;             // the line y is band[(y % (2 * winhalf + 1)) * width + x]
+  std::vector<double> band_sum;         // sums over the lines lo, ..., n_in - 1 for each x
+  std::vector<double> band_sum_squared;
+  std::vector<double> line_sum;         // padded prefix sums of band_sum along the line
+  std::vector<double> line_sum_squared;
+  std::vector<double> count;
+};
 
-  for (int i = winhalf; i < nrow_center; ++i) {
-    for (int j = winhalf; j < ncol_center; ++j) {
-      double mean_local = (integralsum(i+winhalf,j+winhalf) + integralsum(i-winhalf,j-winhalf) - integralsum(i+winhalf,j-winhalf) - integralsum(i-winhalf,j+winhalf)) / winsize_squared;
-      double sd_local = sqrt((integralsum_squared(i+winhalf,j+winhalf) + integralsum_squared(i-winhalf,j-winhalf) - integralsum_squared(i+winhalf,j-winhalf) - integralsum_squared(i-winhalf,j+winhalf)) / winsize_squared - mean_local * mean_local);
-      double threshold_local = mean_local * (1 + k * (sd_local / maxsd - 1));
-      if (mat(i,j) <= threshold_local) {
-        res(i,j) = 0;
-      } else {
-        res(i,j) = 1;
-      }
-    }
+void drop_line_adaptive_stream(adaptive_stream& st) {
+  const double* line = &st.band[(size_t)(st.lo % (2 * st.winhalf + 1)) * st.width];
+  for (int x = 0; x < st.width; ++x) {
+    st.band_sum[x] -= line[x];
+    st.band_sum_squared[x] -= line[x] * line[x];
   }
+  ++st.lo;
+}
 
-  for (int i = nrow_center; i < nrow; ++i) {
-    for (int j = winhalf; j < ncol_center; ++j) {
-      int temp_winsize = (winhalf + nrow - i) * windowsize;
-      double mean_local = (integralsum(nrow-1,j+winhalf) + integralsum(i-winhalf,j-winhalf) - integralsum(nrow-1,j-winhalf) - integralsum(i-winhalf,j+winhalf)) / temp_winsize;
-      double sd_local = sqrt((integralsum_squared(nrow-1,j+winhalf) + integralsum_squared(i-winhalf,j-winhalf) - integralsum_squared(nrow-1,j-winhalf) - integralsum_squared(i-winhalf,j+winhalf)) / temp_winsize - mean_local * mean_local);
-      double threshold_local = mean_local * (1 + k * (sd_local / maxsd - 1));
-      if (mat(i,j) <= threshold_local) {
-        res(i,j) = 0;
-      } else {
-        res(i,j) = 1;
-      }
-    }
+// binarizes the line n_out by the lines lo, ..., n_in - 1
+void emit_line_adaptive_stream(adaptive_stream& st, double* res) {
+  double sum = 0.0;
+  double sum_squared = 0.0;
+  st.line_sum[st.winhalf] = 0.0;
+  st.line_sum_squared[st.winhalf] = 0.0;
+  for (int x = 0; x < st.width; ++x) {
+    sum += st.band_sum[x];
+    sum_squared += st.band_sum_squared[x];
+    st.line_sum[st.winhalf + x + 1] = sum;
+    st.line_sum_squared[st.winhalf + x + 1] = sum_squared;
   }
+  pad_window_sums(st.width, st.winhalf, &st.line_sum[0]);
+  pad_window_sums(st.width, st.winhalf, &st.line_sum_squared[0]);
+  const double* line = &st.band[(size_t)(st.n_out % (2 * st.winhalf + 1)) * st.width];
+  threshold_adaptive_line(line, st.width, st.winhalf, &st.line_sum[0], &st.line_sum_squared[0], &st.count[0],
+                          1.0 / (st.n_in - st.lo), st.k, st.maxsd, res);
+  ++st.n_out;
+}
 
-  for (int i = 0; i < winhalf; ++i) {
-    for (int j = ncol_center; j < ncol; ++j) {
-      int temp_winsize = (winhalf + i + 1) * (winhalf + ncol - j);
-      double mean_local = (integralsum(i+winhalf,ncol-1) - integralsum(i+winhalf,j-winhalf)) / temp_winsize;
-      double sd_local = sqrt((integralsum_squared(i+winhalf,ncol-1) - integralsum_squared(i+winhalf,j-winhalf)) / temp_winsize - mean_local * mean_local);
-      double threshold_local = mean_local * (1 + k * (sd_local / maxsd - 1));
-      if (mat(i,j) <= threshold_local) {
-        res(i,j) = 0;
-      } else {
-        res(i,j) = 1;
-      }
-    }
+// [[Rcpp::export]]
+SEXP adaptive_stream_new(int width, double k, int windowsize, double maxsd) {
+  if (width < 1 || windowsize < 1) {
+    Rcpp::Rcout << "Error: width and windowsize must be positive." << std::endl;
+    return R_NilValue;
   }
+  adaptive_stream* st = new adaptive_stream;
+  int winhalf = windowsize / 2;
+  int winfull = 2 * winhalf + 1;
+  st->width = width;
+  st->winhalf = winhalf;
+  st->k = k;
+  st->maxsd = maxsd;
+  st->n_in = 0;
+  st->n_out = 0;
+  st->lo = 0;
+  st->band.assign((size_t)winfull * width, 0.0);
+  st->band_sum.assign(width, 0.0);
+  st->band_sum_squared.assign(width, 0.0);
+  st->line_sum.assign(width + winfull, 0.0);
+  st->line_sum_squared.assign(width + winfull, 0.0);
+  st->count.assign(width, 0.0);
+  make_window_count(width, winhalf, &st->count[0]);
+  return Rcpp::XPtr<adaptive_stream>(st, true);
+}
 
-  for (int i = winhalf; i < nrow_center; ++i) {
-    for (int j = ncol_center; j < ncol; ++j) {
-      int temp_winsize = windowsize * (winhalf + ncol - j);
-      double mean_local = (integralsum(i+winhalf,ncol-1) + integralsum(i-winhalf,j-winhalf) - integralsum(i+winhalf,j-winhalf) - integralsum(i-winhalf,ncol-1)) / temp_winsize;
-      double sd_local = sqrt((integralsum_squared(i+winhalf,ncol-1) + integralsum_squared(i-winhalf,j-winhalf) - integralsum_squared(i+winhalf,j-winhalf) - integralsum_squared(i-winhalf,ncol-1)) / temp_winsize - mean_local * mean_local);
-      double threshold_local = mean_local * (1 + k * (sd_local / maxsd - 1));
-      if (mat(i,j) <= threshold_local) {
-        res(i,j) = 0;
-      } else {
-        res(i,j) = 1;
-      }
+// gives the lines in lines (width * number of lines) and returns the binarized lines ready (width x number of them)
+// [[Rcpp::export]]
+Rcpp::NumericMatrix adaptive_stream_push(SEXP stream, Rcpp::NumericVector lines) {
+  Rcpp::XPtr<adaptive_stream> ptr(stream);
+  adaptive_stream& st = *ptr;
+  int width = st.width;
+  int winhalf = st.winhalf;
+  int winfull = 2 * winhalf + 1;
+  int n_lines = lines.size() / width;
+  if (n_lines * width != lines.size()) {
+    Rcpp::Rcout << "Error: the number of pixels is not a multiple of width." << std::endl;
+    return Rcpp::NumericMatrix(width, 0);
+  }
+  // the lines n_in - winhalf, ..., n_in + n_lines - winhalf - 1 are returned
+  int n_ready = std::max(0, st.n_in + n_lines - winhalf - st.n_out);
+  Rcpp::NumericMatrix res(width, n_ready);
+  int n_res = 0;
+  for (int l = 0; l < n_lines; ++l) {
+    int y = st.n_in;
+    while (st.lo <= y - winfull) {
+      drop_line_adaptive_stream(st);
+    }
+    const double* src = lines.begin() + (size_t)l * width;
+    double* dst = &st.band[(size_t)(y % winfull) * width];
+    for (int x = 0; x < width; ++x) {
+      dst[x] = src[x];
+      st.band_sum[x] += src[x];
+      st.band_sum_squared[x] += src[x] * src[x];
+    }
+    ++st.n_in;
+    if (y - winhalf >= 0) {
+      emit_line_adaptive_stream(st, res.begin() + (size_t)n_res * width);
+      ++n_res;
     }
   }
+  return res;
+}
 
-  for (int i = nrow_center; i < nrow; ++i) {
-    for (int j = ncol_center; j < ncol; ++j) {
-      int temp_winsize = (winhalf + nrow - i) * (winhalf + ncol - j);
-      double mean_local = (integralsum(nrow-1,ncol-1) + integralsum(i-winhalf,j-winhalf) - integralsum(nrow-1,j-winhalf) - integralsum(i-winhalf,ncol-1)) / temp_winsize;
-      double sd_local = sqrt((integralsum_squared(nrow-1,ncol-1) + integralsum_squared(i-winhalf,j-winhalf) - integralsum_squared(nrow-1,j-winhalf) - integralsum_squared(i-winhalf,ncol-1)) / temp_winsize - mean_local * mean_local);
-      double threshold_local = mean_local * (1 + k * (sd_local / maxsd - 1));
-      if (mat(i,j) <= threshold_local) {
-        res(i,j) = 0;
-      } else {
-        res(i,j) = 1;
-      }
+// returns the last binarized lines after all the lines have been given
+// [[Rcpp::export]]
+Rcpp::NumericMatrix adaptive_stream_finish(SEXP stream) {
+  Rcpp::XPtr<adaptive_stream> ptr(stream);
+  adaptive_stream& st = *ptr;
+  Rcpp::NumericMatrix res(st.width, st.n_in - st.n_out);
+  int n_res = 0;
+  while (st.n_out < st.n_in) {
+    while (st.lo < st.n_out - st.winhalf) {
+      drop_line_adaptive_stream(st);
     }
+    emit_line_adaptive_stream(st, res.begin() + (size_t)n_res * st.width);
+    ++n_res;
   }
-
   return res;
-}
\ No newline at end of file
+}
@@ -17,187 +17,218 @@
  */
 
 #include <Rcpp.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "random_stream.h"
+#include "thresholding_objectives.h"
 
 // [[Rcpp::export]]
-Rcpp::NumericVector make_density_multilevel(Rcpp::NumericVector ordered, Rcpp::NumericVector interval)
+Rcpp::NumericVector make_integral_density_multilevel(Rcpp::NumericVector density)
 {
-  int n = ordered.size();
-  int m = interval.size();
+  int n = density.size();
   if (n == 0) 
   {
     Rcpp::Rcout << "Error: The length of ordered is 0." << std::endl;
     return 0.0;
   }
-  if (m == 0) 
+  Rcpp::NumericVector res(n);
+  double temp = 0.0;
+  for (int i = 0; i < n; ++i)
   {
-    Rcpp::Rcout << "Error: The length of interval is 0." << std::endl;
-    return 0.0;
+    temp += density[i];
+    res[i] = temp;
   }
-  Rcpp::NumericVector res(m);
-  int count = 0;
+  return res;
+}
+
+// -sum p_j log(p_j / omega) / omega over the bins of a segment, where
+// sum_plogp = sum p_j log p_j and mass = sum p_j over the same bins.
+// This is the term of the segment in calculate_entropy_multilevel,
+// and it is 0 if omega is 0. log_omega is log omega, or any finite value if omega is 0.
+// The division by 0 is avoided by selection instead of a branch.
+double entropy_segment_multilevel(double sum_plogp, double mass, double omega, double log_omega)
+{
+  double res = (mass * log_omega - sum_plogp) / (omega == 0.0 ? 1.0 : omega);
+  return omega == 0.0 ? 0.0 : res;
+}
+
+// log_omega[i] = log omega[i], and 0 where omega[i] is 0. log_omega may be omega.
+void log_omega_multilevel(const entropy_kernel& kernel, const double* omega, int n, double* log_omega)
+{
+  #pragma omp simd
   for (int i = 0; i < n; ++i)
   {
-    if (ordered[i] <= interval[count])
-    {
-      ++res[count];
-    } else 
-    {
-      while (ordered[i] > interval[count])
-      {
-        ++count; 
-      }
-      if (count >= m)
-      {
-        break;
-      }
-      ++res[count]; 
-    }
+    log_omega[i] = omega[i] == 0.0 ? 1.0 : omega[i];
   }
-  for (int i = 0; i < m; ++i)
+  kernel.log(log_omega, n, log_omega);
+}
+
+// integral_plogp[j] = sum_{i <= j} p_i log p_i
+void make_integral_plogp_multilevel(const entropy_kernel& kernel, const double* density, int n, double* integral_plogp)
+{
+  kernel.xlogx(density, n, integral_plogp);
+  for (int j = 1; j < n; ++j)
   {
-    res[i] /= n;
+    integral_plogp[j] += integral_plogp[j-1];
   }
-  return res;
 }
 
-// [[Rcpp::export]]
-Rcpp::NumericVector make_integral_density_multilevel(Rcpp::NumericVector density)
+// Entropy of the k thresholds in O(k). The segments are the bins [0, t0],
+// [t0 + 1, t1], ..., [t(k-2) + 1, t(k-1)], and [t(k-1), n - 1]. The last
+// segment includes the bin t(k-1) though its omega doesn't.
+// The k + 1 logarithms are computed by one call of the kernel.
+double calculate_entropy_multilevel(const entropy_kernel& kernel, const double* density, const double* integral_density, const double* integral_plogp, int n, const int* thresholds, int k, double* work)
 {
-  int n = density.size();
-  if (n == 0) 
+  double* omega = work;
+  double* log_omega = work + k + 1;
+  omega[0] = integral_density[thresholds[0]];
+  for (int i = 1; i < k; ++i)
   {
-    Rcpp::Rcout << "Error: The length of ordered is 0." << std::endl;
-    return 0.0;
+    omega[i] = integral_density[thresholds[i]] - integral_density[thresholds[i-1]];
   }
-  Rcpp::NumericVector res(n);
-  double temp = 0.0;
-  for (int i = 0; i < n; ++i)
+  int t = thresholds[k-1];
+  omega[k] = integral_density[n-1] - integral_density[t];
+  log_omega_multilevel(kernel, omega, k + 1, log_omega);
+
+  double res = entropy_segment_multilevel(integral_plogp[thresholds[0]], omega[0], omega[0], log_omega[0]);
+  for (int i = 1; i < k; ++i)
   {
-    temp += density[i];
-    res[i] = temp;
+    res += entropy_segment_multilevel(integral_plogp[thresholds[i]] - integral_plogp[thresholds[i-1]], omega[i], omega[i], log_omega[i]);
   }
+  double sum_plogp = integral_plogp[n-1] - (t > 0 ? integral_plogp[t-1] : 0.0);
+  res += entropy_segment_multilevel(sum_plogp, omega[k] + density[t], omega[k], log_omega[k]);
   return res;
 }
 
-double calculate_entropy_multilevel(Rcpp::NumericVector density, Rcpp::NumericVector integral_density, Rcpp::IntegerVector thresholds)
+// Exact maximum of calculate_entropy_multilevel by dynamic programming.
+// The entropy of each segment is computed in O(1) by the prefix sums of
+// p log p, so the thresholds are found in O(n^2) evaluations of logarithm
+// and O(k n^2) additions. The logarithms of the segments ending at the same
+// bin are computed by one call of the kernel.
+// Ties are broken in favor of the smallest thresholds.
+// [[Rcpp::export]]
+Rcpp::IntegerVector get_threshold_multilevel_exact(Rcpp::NumericVector im_density, Rcpp::NumericVector im_integral_density, int n_thres)
 {
-  int n = density.size();
-  int k = thresholds.size();
-  double res = 0.0;
-  
-  double omega0 = integral_density[thresholds[0]];
-  double h0 = 0.0;
-  if (omega0 != 0.0)
+  int n = im_density.size();
+  if (n != im_integral_density.size())
   {
-    for (int j = 0; j <= thresholds[0]; ++j)
-    {
-      if (density[j] != 0.0)
-      {
-        h0 += density[j] * std::log(density[j] / omega0) / omega0;
-      }
-    }
+    Rcpp::Rcout << "Error: The length of im_density is not same as the length of im_integral_density." << std::endl;
+    return Rcpp::IntegerVector(0);
   }
-  res -= h0;
-  for (int i = 1; i < k; ++i)
+  if (n_thres < 1 || n_thres > n)
   {
-    double omegak = integral_density[thresholds[i]] - integral_density[thresholds[i-1]];
-    double hk = 0.0;
-    for (int j = thresholds[i-1] + 1; j <= thresholds[i]; ++j)
-    {
-      if (density[j] != 0.0)
-      {
-        hk += density[j] * std::log(density[j] / omegak) / omegak;
-      }
-    }
-    res -= hk;
+    Rcpp::Rcout << "Error: n_thres must be in [1, length of im_density]." << std::endl;
+    return Rcpp::IntegerVector(0);
+  }
+  const double* density = im_density.begin();
+  const double* integral = im_integral_density.begin();
+
+  const entropy_kernel& kernel = entropy_kernel_best();
+  std::vector<double> integral_plogp(n);
+  make_integral_plogp_multilevel(kernel, density, n, &integral_plogp[0]);
+  std::vector<double> omega(n);
+  std::vector<double> log_omega(n);
+
+  // best[i * n + t] is the maximum entropy of the segments before the threshold i
+  // when the threshold i is t, and from[i * n + t] is the threshold i - 1 giving it.
+  std::vector<double> best(n_thres * n, -HUGE_VAL);
+  std::vector<int> from(n_thres * n, -1);
+  log_omega_multilevel(kernel, integral, n, &log_omega[0]);
+  for (int t = 0; t < n; ++t)
+  {
+    best[t] = entropy_segment_multilevel(integral_plogp[t], integral[t], integral[t], log_omega[t]);
   }
-  double omegan = integral_density[n-1] - integral_density[thresholds[k-1]];
-  double hn = 0.0;
-  if (omegan != 0.0)
+  for (int t = 1; t < n; ++t)
   {
-    for (int j = thresholds[k-1]; j < n; ++j)
+    // the segments [s + 1, t] for s < t
+    #pragma omp simd
+    for (int s = 0; s < t; ++s)
     {
-      if (density[j] != 0.0)
+      omega[s] = integral[t] - integral[s];
+    }
+    log_omega_multilevel(kernel, &omega[0], t, &log_omega[0]);
+    for (int s = 0; s < t; ++s)
+    {
+      double e = entropy_segment_multilevel(integral_plogp[t] - integral_plogp[s], omega[s], omega[s], log_omega[s]);
+      int imax = std::min(n_thres - 1, s + 1);
+      for (int i = 1; i <= imax; ++i)
       {
-        hn += density[j] * std::log(density[j] / omegan) / omegan;
+        double val = best[(i - 1) * n + s] + e;
+        if (val > best[i * n + t])
+        {
+          best[i * n + t] = val;
+          from[i * n + t] = s;
+        }
       }
     }
   }
-  res -= hn;
-  return res;
-}
 
-Rcpp::IntegerVector generate_inipos_multilevel(int n_thres, int maxnum_interval)
-{
-  Rcpp::IntegerVector res(n_thres);
-  Rcpp::NumericVector tmp = Rcpp::runif(n_thres, 0, maxnum_interval);
-  std::sort(tmp.begin(), tmp.end());
-  for (int i = 0; i < n_thres; ++i)
+  // the last segment [t, n - 1] includes the last threshold t
+  int last = -1;
+  double beste = -HUGE_VAL;
+  for (int t = 0; t < n; ++t)
   {
-    tmp[i] = (int)tmp[i];
+    omega[t] = integral[n-1] - integral[t];
   }
-  bool tmpbool = false;
-  for (int i = 0; i < n_thres - 1; ++i)
+  log_omega_multilevel(kernel, &omega[0], n, &log_omega[0]);
+  for (int t = n_thres - 1; t < n; ++t)
   {
-    if (tmp[i] == tmp[i+1])
+    double sum_plogp = integral_plogp[n-1] - (t > 0 ? integral_plogp[t-1] : 0.0);
+    double val = best[(n_thres - 1) * n + t] + entropy_segment_multilevel(sum_plogp, omega[t] + density[t], omega[t], log_omega[t]);
+    if (val > beste)
     {
-      tmpbool = true;
-      break;
+      beste = val;
+      last = t;
     }
   }
-  while (tmpbool)
+
+  Rcpp::IntegerVector res(n_thres);
+  res[n_thres - 1] = last;
+  for (int i = n_thres - 1; i > 0; --i)
   {
-    tmp = Rcpp::runif(n_thres, 0, maxnum_interval);
-    std::sort(tmp.begin(), tmp.end());
-    for (int j = 0; j < n_thres; ++j)
-    {
-      tmp[j] = (int)tmp[j];
-    }
-    tmpbool = false;
-    for (int i = 0; i < n_thres - 1; ++i)
-    {
-      if (tmp[i] == tmp[i+1])
-      {
-        tmpbool = true;
-        break;
-      }
-    }
+    res[i - 1] = from[i * n + res[i]];
   }
   for (int i = 0; i < n_thres; ++i)
   {
-    res[i] = (int)tmp[i];
+    res[i] += 1;
   }
   return res;
 }
 
-int generate_randint_multilevel(int n_ex, int maxnum)
+bool check_dupl_multilevel(const int* vec, int n)
 {
-  if (maxnum <= 1)
+  for (int i = 0; i < n - 1; ++i)
   {
-    Rcpp::Rcout << "maxnum is smaller than 2 in generate_randint_multilevel." << std::endl;
-    return 0;
+    if (vec[i] == vec[i+1])
+    {
+      return true;
+    }
   }
-  Rcpp::NumericVector tmp = Rcpp::runif(1, 0, maxnum);
-  int res = (int)tmp[0];
-  while (res == n_ex)
-  {
-    tmp = Rcpp::runif(1, 0, maxnum);
-  res = (int)tmp[0];
-  }  
-  return res;
+  return false;
 }
 
-bool check_dupl_multilevel(Rcpp::IntegerVector vec)
+template<class RNG>
+void generate_inipos_multilevel(int n_thres, int maxnum_interval, RNG& rng, int* res)
 {
-  int n = vec.size();
-  bool res = false;
-  for (int i = 0; i < n - 1; ++i)
+  do
   {
-    if (vec[i] == vec[i+1])
+    for (int i = 0; i < n_thres; ++i)
     {
-      res = true;
-      break;
+      res[i] = (int)rng.unif(0, maxnum_interval);
     }
+    std::sort(res, res + n_thres);
+  } while (check_dupl_multilevel(res, n_thres));
+}
+
+// random integer in [0, maxnum) other than n_ex. maxnum must be greater than 1.
+template<class RNG>
+int generate_randint_multilevel(int n_ex, int maxnum, RNG& rng)
+{
+  int res = (int)rng.unif(0, maxnum);
+  while (res == n_ex)
+  {
+    res = (int)rng.unif(0, maxnum);
   }
   return res;
 }
@@ -207,96 +238,69 @@ bool compare_pairsecond_multilevel(std::pair<int, double> x, std::pair<int, doub
   return x.second > y.second;
 }
 
-Rcpp::IntegerVector generate_newpos_multilevel(int j, int sn, int n_thres, int n, Rcpp::IntegerMatrix prepos)
+int clamp_multilevel(int pos, int n)
 {
-  int tmpidx = generate_randint_multilevel(j, sn);
-  Rcpp::NumericVector tmprand = Rcpp::runif(n_thres, -1, 1);
-  Rcpp::IntegerVector newpos(n_thres);
-  for (int k = 0; k < n_thres; ++k)
-  {
-    int tmppos = (int)(prepos(j,k) + tmprand[k] * (prepos(j,k) - prepos(tmpidx,k)));
-    if (tmppos < 0)
-  {
-    tmppos = 0;
-  } else if (tmppos >= n)
-  {
-    tmppos = n - 1;
-  }
-  newpos[k] = tmppos;
-  }
-  std::sort(newpos.begin(), newpos.end());
-  bool flag_dupl = check_dupl_multilevel(newpos);
-  while (flag_dupl)
+  return pos < 0 ? 0 : (pos >= n ? n - 1 : pos);
+}
+
+// prepos is the sn x n_thres row-major matrix of the positions of the food sources
+template<class RNG>
+void generate_newpos_multilevel(int j, int sn, int n_thres, int n, const int* prepos, RNG& rng, int* newpos)
+{
+  const int* posj = prepos + j * n_thres;
+  do
   {
-    tmpidx = generate_randint_multilevel(j, sn);
-    tmprand = Rcpp::runif(n_thres, -1, 1);
+    const int* posidx = prepos + generate_randint_multilevel(j, sn, rng) * n_thres;
     for (int k = 0; k < n_thres; ++k)
     {
-      int tmppos = (int)(prepos(j,k) + tmprand[k] * (prepos(j,k) - prepos(tmpidx,k)));
-      if (tmppos < 0)
-      {
-        tmppos = 0;
-      } else if (tmppos >= n)
-      {
-        tmppos = n - 1;
-      }
-      newpos[k] = tmppos;
+      newpos[k] = clamp_multilevel((int)(posj[k] + rng.unif(-1, 1) * (posj[k] - posidx[k])), n);
     }
-    std::sort(newpos.begin(), newpos.end());
-    flag_dupl = check_dupl_multilevel(newpos);
-  } 
-  return newpos;
+    std::sort(newpos, newpos + n_thres);
+  } while (check_dupl_multilevel(newpos, n_thres));
 }
 
-// [[Rcpp::export]]
-Rcpp::IntegerVector get_threshold_multilevel(Rcpp::NumericVector im_density, Rcpp::NumericVector im_integral_density, int n_thres, int sn, int mcn, int limit)
+// One colony of the artificial bee colony algorithm. The best thresholds
+// (0-based) are written to gbest, and their entropy is returned.
+// Every candidate is evaluated in O(n_thres) by the prefix sums of p log p.
+// It doesn't touch R objects, so colonies with their own RandomStream can run in parallel.
+template<class RNG>
+double abc_multilevel(const entropy_kernel& kernel, const double* density, const double* integral, const double* integral_plogp, int n, int n_thres, int sn, int mcn, int limit, RNG& rng, int* gbest)
 {
-  int n = im_density.size();
-  if (n != im_integral_density.size())
-  {
-    Rcpp::Rcout << "The length of im_density is not same as the length of im_integral_density." << std::endl;
-  }
-  Rcpp::IntegerVector gbest(n_thres);
-  Rcpp::IntegerMatrix prepos(sn, n_thres);
+  std::vector<int> prepos(sn * n_thres);
   double gbeste = 0.0;
-  Rcpp::NumericVector prepe(sn);
-  Rcpp::IntegerVector ptrail(sn);
-  Rcpp::IntegerVector pflags(sn);
+  std::vector<double> prepe(sn);
+  std::vector<int> ptrail(sn, 0);
+  std::vector<int> pflags(sn, 0);
+  std::vector<int> newpos(n_thres);
+  std::vector<int> pmax(n_thres);
+  std::vector<int> pmin(n_thres);
+  std::vector<double> work(2 * (n_thres + 1));
 
   // step 1. generate initial position
   for (int i = 0; i < sn; ++i)
   {
-    Rcpp::IntegerVector tmpvec = generate_inipos_multilevel(n_thres, n);
-    for (int j = 0; j < n_thres; ++j)
-  {
-    prepos(i,j) = tmpvec[j];
-  }
-    prepe[i] = calculate_entropy_multilevel(im_density, im_integral_density, tmpvec);
+    int* posi = &prepos[i * n_thres];
+    generate_inipos_multilevel(n_thres, n, rng, posi);
+    prepe[i] = calculate_entropy_multilevel(kernel, density, integral, integral_plogp, n, posi, n_thres, &work[0]);
     if (prepe[i] >= gbeste)
     {
       gbeste = prepe[i];
-      for (int j = 0; j < n_thres; ++j)
-      {
-        gbest[j] = prepos(i,j);
-      }
+      std::copy(posi, posi + n_thres, gbest);
     }
-  }  
+  }
 
   for (int cycle = 0; cycle < mcn; ++cycle)
   {
     // step 2. place the employed bees
     for (int j = 0; j < sn; ++j)
     {
-    Rcpp::IntegerVector newpos = generate_newpos_multilevel(j, sn, n_thres, n, prepos);
-      double newpose = calculate_entropy_multilevel(im_density, im_integral_density, newpos);
+      generate_newpos_multilevel(j, sn, n_thres, n, &prepos[0], rng, &newpos[0]);
+      double newpose = calculate_entropy_multilevel(kernel, density, integral, integral_plogp, n, &newpos[0], n_thres, &work[0]);
       if (newpose >= prepe[j])
       {
         pflags[j] = 1;
         prepe[j] = newpose;
-        for (int l = 0; l < n_thres; ++l)
-        {
-          prepos(j,l) = newpos[l];
-        }
+        std::copy(newpos.begin(), newpos.end(), prepos.begin() + j * n_thres);
       }
     }
 
@@ -321,21 +325,18 @@ Rcpp::IntegerVector get_threshold_multilevel(Rcpp::NumericVector im_density, Rcp
     std::sort(probs.begin(), probs.end(), compare_pairsecond_multilevel);
     for (int i = 0; i < sn; ++i)
     {
-      Rcpp::NumericVector temprand = Rcpp::runif(1, 0, 1);
+      double temprand = rng.unif(0, 1);
       for (int j = 0; j < sn; ++j)
       {
-        if (temprand[0] < probs[j].second)  
+        if (temprand < probs[j].second)  
         {
-          Rcpp::IntegerVector newpos = generate_newpos_multilevel(probs[j].first, sn, n_thres, n, prepos);
-          double newpose = calculate_entropy_multilevel(im_density, im_integral_density, newpos);
+          generate_newpos_multilevel(probs[j].first, sn, n_thres, n, &prepos[0], rng, &newpos[0]);
+          double newpose = calculate_entropy_multilevel(kernel, density, integral, integral_plogp, n, &newpos[0], n_thres, &work[0]);
           if (newpose >= prepe[j])
           {
             pflags[j] = 1;
             prepe[j] = newpose;
-            for (int l = 0; l < n_thres; ++l)
-            {
-            prepos(j,l) = newpos[l];
-            }
+            std::copy(newpos.begin(), newpos.end(), prepos.begin() + j * n_thres);
           }
           break;          
         }
@@ -343,92 +344,52 @@ Rcpp::IntegerVector get_threshold_multilevel(Rcpp::NumericVector im_density, Rcp
     }
  
     // step 4. Send the scounts
+    bool flag_scout = false;
     for (int i = 0; i < sn; ++i)
     {
       if (pflags[i] == 0)
       {
         ptrail[i] += 1;
       }
-    }
-    double flag_scout = false;
-    for (int i = 0; i < sn; ++i)
-    {
       if (ptrail[i] > limit)
       {
         flag_scout = true;
-        break;
       }
     }
     if (flag_scout)
     {
-      Rcpp::IntegerVector pmax(n_thres);
-      Rcpp::IntegerVector pmin(n_thres);
-      for (int i = 0; i < n_thres; ++i)
+      for (int j = 0; j < n_thres; ++j)
       {
-        pmax[i] = prepos(0,i);
-        pmin[i] = prepos(0,i);
+        pmax[j] = prepos[j];
+        pmin[j] = prepos[j];
       }
       for (int i = 1; i < sn; ++i)
       {
         for (int j = 0; j < n_thres; ++j)
         {
-          if (prepos(i,j) > pmax[j])
-          {
-            pmax[j] = prepos(i,j);
-          }
-          if (prepos(i,j) < pmin[j])
-          {
-            pmin[j] = prepos(i,j);
-          }
+          pmax[j] = std::max(pmax[j], prepos[i * n_thres + j]);
+          pmin[j] = std::min(pmin[j], prepos[i * n_thres + j]);
         }
       }
       for (int i = 0; i < sn; ++i)
       {
         if (ptrail[i] > limit)
         {
-          Rcpp::IntegerVector newpos(n_thres);
-          Rcpp::NumericVector tmpunif = Rcpp::runif(n_thres, 0, 1);
-          for (int j = 0; j < n_thres; ++j)
-          {
-            int tmppos = (int)(prepos(i,j) + tmpunif[j] * (pmax[j] - pmin[j]));
-            if (tmppos < 0)
-            {
-              tmppos = 0;
-            } else if (tmppos >= n)
-            {
-              tmppos = n - 1;
-            }
-            newpos[j] = tmppos;
-          }
-          std::sort(newpos.begin(), newpos.end());
-          bool flag_dupl = check_dupl_multilevel(newpos);
-          while (flag_dupl)
+          const int* posi = &prepos[i * n_thres];
+          do
           {
-            tmpunif = Rcpp::runif(n_thres, 0, 1);
             for (int j = 0; j < n_thres; ++j)
             {
-              int tmppos = (int)(prepos(i,j) + tmpunif[j] * (pmax[j] - pmin[j]));
-              if (tmppos < 0)
-              {
-                tmppos = 0;
-              } else if (tmppos >= n)
-              {
-                tmppos = n - 1;
-              }
-              newpos[j] = tmppos;
+              newpos[j] = clamp_multilevel((int)(posi[j] + rng.unif(0, 1) * (pmax[j] - pmin[j])), n);
             }
             std::sort(newpos.begin(), newpos.end());
-            flag_dupl = check_dupl_multilevel(newpos);
-          }
-          double newpose = calculate_entropy_multilevel(im_density, im_integral_density, newpos);
+          } while (check_dupl_multilevel(&newpos[0], n_thres));
+          double newpose = calculate_entropy_multilevel(kernel, density, integral, integral_plogp, n, &newpos[0], n_thres, &work[0]);
           if (newpose >= prepe[i])
           {
             ptrail[i] = 0;
             prepe[i] = newpose;
-            for (int l = 0; l < n_thres; ++l)
-            {
-              prepos(i,l) = newpos[l];
-            }
+            std::copy(newpos.begin(), newpos.end(), prepos.begin() + i * n_thres);
           }
         }
       }
@@ -440,19 +401,82 @@ Rcpp::IntegerVector get_threshold_multilevel(Rcpp::NumericVector im_density, Rcp
       if (prepe[i] >= gbeste)
       {
         gbeste = prepe[i];
-        for (int j = 0; j < n_thres; ++j)
-        {
-          gbest[j] = prepos(i,j);
-        }
+        std::copy(prepos.begin() + i * n_thres, prepos.begin() + (i + 1) * n_thres, gbest);
       }
     }
+  }
+  return gbeste;
+}
+
+// Multilevel thresholding by the artificial bee colony algorithm.
+// nruns: number of independent colonies. The thresholds of the colony of the
+//        largest entropy are returned, the first colony in case of a tie.
+// seed: seed of the random number streams of the colonies. If seed is NA or NaN, one
+//       colony runs with R's random number generator, and nruns must be 1.
+// nthreads: number of threads. the result does not depend on nthreads.
+// [[Rcpp::export]]
+Rcpp::IntegerVector get_threshold_multilevel(Rcpp::NumericVector im_density, Rcpp::NumericVector im_integral_density, int n_thres, int sn, int mcn, int limit, int nruns, double seed, int nthreads)
+{
+  int n = im_density.size();
+  if (n != im_integral_density.size())
+  {
+    Rcpp::Rcout << "Error: The length of im_density is not same as the length of im_integral_density." << std::endl;
+    return Rcpp::IntegerVector(0);
+  }
+  if (n_thres < 1 || n_thres > n)
+  {
+    Rcpp::Rcout << "Error: n_thres must be in [1, length of im_density]." << std::endl;
+    return Rcpp::IntegerVector(0);
+  }
+  if (sn < 2)
+  {
+    Rcpp::Rcout << "Error: sn must be greater than or equal to 2." << std::endl;
+    return Rcpp::IntegerVector(0);
+  }
+  if (nruns < 1 || (std::isnan(seed) && nruns != 1))
+  {
+    Rcpp::Rcout << "Error: nruns must be positive, and it must be 1 if seed is NA." << std::endl;
+    return Rcpp::IntegerVector(0);
+  }
+  if (nthreads < 1)
+  {
+    nthreads = 1;
+  }
+  const double* density = im_density.begin();
+  const double* integral = im_integral_density.begin();
+  const entropy_kernel& kernel = entropy_kernel_best();
+  std::vector<double> integral_plogp(n);
+  make_integral_plogp_multilevel(kernel, density, n, &integral_plogp[0]);
 
+  std::vector<int> gbest(nruns * n_thres);
+  std::vector<double> gbeste(nruns);
+  if (std::isnan(seed))
+  {
+    RandomRBatch rng;
+    gbeste[0] = abc_multilevel(kernel, density, integral, &integral_plogp[0], n, n_thres, sn, mcn, limit, rng, &gbest[0]);
+  } else
+  {
+    #pragma omp parallel for num_threads(std::min(nthreads, nruns)) schedule(dynamic, 1)
+    for (int r = 0; r < nruns; ++r)
+    {
+      RandomStream rng((uint64_t)(int64_t)seed, r);
+      gbeste[r] = abc_multilevel(kernel, density, integral, &integral_plogp[0], n, n_thres, sn, mcn, limit, rng, &gbest[r * n_thres]);
+    }
+  }
+  int best = 0;
+  for (int r = 1; r < nruns; ++r)
+  {
+    if (gbeste[r] > gbeste[best])
+    {
+      best = r;
+    }
   }
+  Rcpp::IntegerVector res(n_thres);
   for (int i = 0; i < n_thres; ++i)
   {
-    gbest[i] += 1;
+    res[i] = gbest[best * n_thres + i] + 1;
   }
-  return gbest;
+  return res;
 }
 
 // [[Rcpp::export]]
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2018, Shota Ochi <shotaochi1990@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Rcpp.h>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "entropy_kernels.h"
+#include "thresholding_objectives.h"
+
+// Reference check of the kernels of entropy_kernels.h on n random values.
+// For each kernel supported by the running CPU, returns the maximum relative
+// errors of log and log_approx, the maximum absolute errors of xlogx and
+// shannon against std::log, and 1 if all the results are the same as those
+// of the scalar kernel bit for bit, 0 otherwise.
+// [[Rcpp::export]]
+Rcpp::NumericVector entropy_kernels_check(int n)
+{
+  entropy_kernel kernels[2];
+  int n_kernels = entropy_kernel_available(kernels, 2);
+  Rcpp::NumericVector res(n_kernels * 5);
+  Rcpp::CharacterVector res_names(n_kernels * 5);
+
+  // positive values over the whole range of the exponent, and values in [0, 1] with 0 and 1
+  Rcpp::NumericVector randval = Rcpp::runif(n, -700, 700);
+  std::vector<double> x(n);
+  std::vector<double> p(n);
+  for (int i = 0; i < n; ++i)
+  {
+    x[i] = std::exp(randval[i]);
+    p[i] = i % 16 == 0 ? 0.0 : (i % 16 == 1 ? 1.0 : (randval[i] + 700) / 1400);
+  }
+  std::vector<double> y(4 * n);
+  std::vector<double> y_scalar(4 * n);
+  for (int l = 0; l < n_kernels; ++l)
+  {
+    const entropy_kernel& kernel = kernels[l];
+    kernel.log(&x[0], n, &y[0]);
+    kernel.log_approx(&x[0], n, &y[n]);
+    kernel.xlogx(&p[0], n, &y[2 * n]);
+    kernel.shannon(&p[0], n, &y[3 * n]);
+    if (l == 0)
+    {
+      y_scalar = y;
+    }
+    double maxdiff[4] = {0.0, 0.0, 0.0, 0.0};
+    for (int i = 0; i < n; ++i)
+    {
+      double ref = std::log(x[i]);
+      if (ref != 0)
+      {
+        maxdiff[0] = std::max(maxdiff[0], std::fabs(y[i] - ref) / std::fabs(ref));
+        maxdiff[1] = std::max(maxdiff[1], std::fabs(y[n + i] - ref) / std::fabs(ref));
+      }
+      double xlogx = p[i] == 0 ? 0.0 : p[i] * std::log(p[i]);
+      double shannon = (p[i] == 0 || p[i] == 1) ? 0.0 : -p[i] * std::log(p[i]) - (1 - p[i]) * std::log(1 - p[i]);
+      maxdiff[2] = std::max(maxdiff[2], std::fabs(y[2 * n + i] - xlogx));
+      maxdiff[3] = std::max(maxdiff[3], std::fabs(y[3 * n + i] - shannon));
+    }
+    const char* labels[4] = {"log", "log_approx", "xlogx", "shannon"};
+    for (int f = 0; f < 4; ++f)
+    {
+      res[l * 5 + f] = maxdiff[f];
+      res_names[l * 5 + f] = std::string(kernel.name) + " " + labels[f];
+    }
+    res[l * 5 + 4] = std::memcmp(&y[0], &y_scalar[0], 4 * n * sizeof(double)) == 0 ? 1.0 : 0.0;
+    res_names[l * 5 + 4] = std::string(kernel.name) + " same";
+  }
+  res.attr("names") = res_names;
+  return res;
+}
+
+// Microbenchmark of the objective functions of the thresholding functions.
+// A histogram of n_bins bins is evaluated n_reps times by each objective with
+// each kernel supported by the running CPU, and the time per bin is reported.
+// fuzzy: calc_fuzzy_entropy for the pairs (a, c) spread over the histogram
+// multilevel: the prefix sums of p log p and calculate_entropy_multilevel of 3 thresholds
+// otsu: calc_threshold_otsu, which doesn't use the kernels
+// Returns a list of the columns objective, kernel, and ns_per_bin.
+// [[Rcpp::export]]
+Rcpp::List objective_benchmark(int n_bins, int n_reps)
+{
+  if (n_bins < 4 || n_reps < 1)
+  {
+    Rcpp::Rcout << "Error: n_bins must be greater than 3, and n_reps must be positive." << std::endl;
+    return Rcpp::List::create();
+  }
+  entropy_kernel kernels[2];
+  int n_kernels = entropy_kernel_available(kernels, 2);
+
+  // a histogram of two peaks with some empty bins
+  std::vector<double> imhist(n_bins);
+  std::vector<double> interval(n_bins);
+  double total = 0.0;
+  for (int i = 0; i < n_bins; ++i)
+  {
+    double x = (double)i / n_bins;
+    imhist[i] = i % 7 == 3 ? 0.0 : std::floor(1000 * (std::exp(-(x - 0.3) * (x - 0.3) / 0.01) + 0.5 * std::exp(-(x - 0.7) * (x - 0.7) / 0.02)) + 1);
+    interval[i] = (i + 1.0) / n_bins;
+    total += imhist[i];
+  }
+  std::vector<double> density(n_bins);
+  std::vector<double> integral(n_bins);
+  double tmp = 0.0;
+  for (int i = 0; i < n_bins; ++i)
+  {
+    density[i] = imhist[i] / total;
+    tmp += density[i];
+    integral[i] = tmp;
+  }
+  std::vector<double> integral_plogp(n_bins);
+  std::vector<double> work(3 * n_bins + 2);
+  int thresholds[3] = {n_bins / 4, n_bins / 2, 3 * n_bins / 4};
+
+  Rcpp::CharacterVector objective;
+  Rcpp::CharacterVector kernel_name;
+  Rcpp::NumericVector ns_per_bin;
+  double sink = 0.0;
+  for (int f = 0; f < 3; ++f)
+  {
+    for (int l = 0; l < n_kernels; ++l)
+    {
+      const entropy_kernel& kernel = kernels[l];
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      for (int r = 0; r < n_reps; ++r)
+      {
+        if (f == 0)
+        {
+          int a = (r * 7) % (n_bins / 2);
+          sink += calc_fuzzy_entropy(kernel, &imhist[0], &interval[0], a, n_bins - 1 - (r * 3) % (n_bins / 4));
+        } else if (f == 1)
+        {
+          make_integral_plogp_multilevel(kernel, &density[0], n_bins, &integral_plogp[0]);
+          sink += calculate_entropy_multilevel(kernel, &density[0], &integral[0], &integral_plogp[0], n_bins, thresholds, 3, &work[0]);
+        } else
+        {
+          sink += calc_threshold_otsu(&density[0], &interval[0], n_bins, &work[0]);
+        }
+      }
+      std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+      const char* labels[3] = {"fuzzy", "multilevel", "otsu"};
+      objective.push_back(labels[f]);
+      kernel_name.push_back(f == 2 ? "none" : kernel.name);
+      ns_per_bin.push_back(elapsed.count() / ((double)n_reps * n_bins));
+      if (f == 2)
+      {
+        break;
+      }
+    }
+  }
+  if (std::isnan(sink))
+  {
+    Rcpp::Rcout << "Warning: an objective returned NaN." << std::endl;
+  }
+  return Rcpp::List::create(Rcpp::Named("objective") = objective, Rcpp::Named("kernel") = kernel_name, Rcpp::Named("ns_per_bin") = ns_per_bin);
+}
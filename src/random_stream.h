@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2018, Shota Ochi <shotaochi1990@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGEREXTRA_RANDOM_STREAM_H
+#define IMAGEREXTRA_RANDOM_STREAM_H
+
+#include <Rcpp.h>
+#include <cmath>
+#include <stdint.h>
+
+// Random number generators used by the metaheuristics of the thresholding
+// functions. Each of them has
+//   double unif(double a, double b): a uniform random number in [a, b)
+//   double norm(double mean, double sd): a normal random number
+
+// R's random number generator, one number at a time.
+// It must be used only by the main thread.
+class RandomR
+{
+public:
+  double unif(double a, double b)
+  {
+    return a + (b - a) * unif_rand();
+  }
+  double norm(double mean, double sd)
+  {
+    return mean + sd * norm_rand();
+  }
+};
+
+#define RANDOM_R_BATCH 1024
+
+// R's random number generator. Uniform random numbers are drawn in batches.
+// It must be used only by the main thread.
+class RandomRBatch
+{
+public:
+  RandomRBatch() : pos(RANDOM_R_BATCH) {}
+  double unif(double a, double b)
+  {
+    if (pos == RANDOM_R_BATCH)
+    {
+      buf = Rcpp::runif(RANDOM_R_BATCH, 0, 1);
+      pos = 0;
+    }
+    return a + (b - a) * buf[pos++];
+  }
+  double norm(double mean, double sd)
+  {
+    return mean + sd * norm_rand();
+  }
+
+private:
+  Rcpp::NumericVector buf;
+  int pos;
+};
+
+// Counter-based random number generator. The i-th number of the stream
+// (seed, stream) is a hash of the key of the stream and i, so the streams of
+// one seed are independent and reproducible whatever thread uses them.
+// The hash is the finalizer of SplitMix64.
+class RandomStream
+{
+public:
+  RandomStream(uint64_t seed, uint64_t stream) : key(mix(mix(seed) ^ (stream * 0xD1B54A32D192ED03ULL))), counter(0) {}
+  double unif(double a, double b)
+  {
+    return a + (b - a) * next();
+  }
+  // Box-Muller transform of two uniform random numbers
+  double norm(double mean, double sd)
+  {
+    double u1 = 1.0 - next();
+    double u2 = next();
+    return mean + sd * std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2);
+  }
+
+private:
+  static uint64_t mix(uint64_t z)
+  {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+  // uniform random number in [0, 1) with 53 random bits
+  double next()
+  {
+    uint64_t z = mix(key + (++counter) * 0x9E3779B97F4A7C15ULL);
+    return (z >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+  uint64_t key;
+  uint64_t counter;
+};
+
+#endif
@@ -24,6 +24,9 @@
  */
 
 #include <Rcpp.h>
+#include <vector>
+#include "fast_discrete_cosine_transoformation.h"
+#include "simplest_color_balance.h"
 
 /* M_PI is a POSIX definition */
 #ifndef M_PI2
@@ -38,39 +41,76 @@
  *    =(PI² i²/nx²+ PI²j²/ny²) g(i,j) @f$
  *
  * @param data  input array dct of the input image of size nx x ny
+ * @param data_out output array, which may be data
  * @param nx data array size
  * @param ny data array size
  * @param L the constant of the screened equation
- *
- * @return the data array, update
  */
-// [[Rcpp::export]]
-Rcpp::NumericMatrix screened_poisson_dct(Rcpp::NumericMatrix data, double L)
+void screened_poisson_gain(const double* data, double* data_out, int nx, int ny, double L)
 {
-    int nx = data.nrow();
-    int ny = data.ncol();
-    Rcpp::NumericMatrix data_out(Rcpp::Dimension(nx, ny));
     double normx, normy, coeff, coeff1;
     normx = 4.0 * M_PI2 / (double)(nx * nx);
     normy = 4.0 * M_PI2 / (double)(ny * ny);
 
-    if (L > 0.)
+    if (!(L > 0.))
+    {
+        std::fill(data_out, data_out + nx * ny, 0.0);
+        return;
+    }
+    for (int j = 0; j < ny; ++j)
     {
         for (int i = 0; i < nx; ++i)
         {
-            for (int j = 0; j < ny; ++j)
+            if (i == 0 && j == 0) 
             {
-                if (i == 0 && j == 0) 
-                {
-                    data_out(0, 0) = 0.;
-                } else
-                {
-                    coeff = normx * i * i + normy * j * j;
-                    coeff1 = coeff / (coeff + L);
-                    data_out(i, j) = data(i, j) * coeff1;
-                }
+                data_out[0] = 0.;
+            } else
+            {
+                coeff = normx * i * i + normy * j * j;
+                coeff1 = coeff / (coeff + L);
+                data_out[i + j * nx] = data[i + j * nx] * coeff1;
             }
         }
     }
-    return data_out;
-}   
\ No newline at end of file
+}
+
+/**
+ * @brief Screened Poisson Equation in one pass:
+ * Simplest Color Balance, DCT, screened Poisson gain, inverse DCT, and
+ * Simplest Color Balance again.
+ * The balance and the DCT are computed once and shared by all the constants,
+ * so each constant costs one gain pass, one inverse DCT, and one balance.
+ *
+ * @param im input image of size nx x ny
+ * @param L the constants of the screened equation
+ * @param s saturation percentage of both sides
+ * @param max_range maximum of the range of the pixel values
+ * @param min_range minimum of the range of the pixel values
+ *
+ * @return a list of the corrected images, one for each constant
+ */
+// [[Rcpp::export]]
+Rcpp::List screened_poisson_equation(Rcpp::NumericMatrix im, Rcpp::NumericVector L, double s, double max_range, double min_range)
+{
+    int nx = im.nrow();
+    int ny = im.ncol();
+    int n = nx * ny;
+    int num_L = L.size();
+    Rcpp::List res(num_L);
+    std::vector<double> coef(n);
+    std::vector<double> scratch(n);
+
+    balance_simplest_apply(im.begin(), &coef[0], n, s, s, max_range, min_range, &scratch[0]);
+    std::shared_ptr<const DCT2Dplan> plan = DCT2Dplan_cached(nx, ny);
+    plan->forward(&coef[0], &coef[0]);
+    for (int l = 0; l < num_L; ++l)
+    {
+        Rcpp::NumericMatrix data(nx, ny);
+        double* ptr_data = data.begin();
+        screened_poisson_gain(&coef[0], ptr_data, nx, ny, L[l]);
+        plan->inverse(ptr_data, ptr_data);
+        balance_simplest_apply(ptr_data, ptr_data, n, s, s, max_range, min_range, &scratch[0]);
+        res[l] = data;
+    }
+    return res;
+}
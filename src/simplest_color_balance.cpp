@@ -20,40 +20,77 @@
  //$ That's why the copy right holder of the code below is Catalina Sbert.
  
 #include <Rcpp.h>
+#include <algorithm>
+#include "simplest_color_balance.h"
 
 
 /**
 * @brief Main block of Simplest Color Balance
 *
 * @param data initial array
+* @param data_out saturated array
+* @param n size of data
 * @param max_im maximum of the saturated image
 * @param min_im minimum of the saturated image
 * @param max_range maximum of the range of the pixel values
 * @param min_range minimum of the range of the pixel values
 **/
-// [[Rcpp::export]]
-Rcpp::NumericVector saturateim(Rcpp::NumericVector data, double max_im, double min_im, double max_range, double min_range)
+void saturate(const double* data, double* data_out, int n, double max_im, double min_im, double max_range, double min_range)
 {
-    int n = data.size();
-    Rcpp::NumericVector data_out(n);
-    data_out.fill(0.0);
-    double* ptr_data_out = data_out.begin();
     double slope = (max_range - min_range) / (max_im - min_im);
 
     for (int i = 0; i < n; ++i) 
     {
         if (data[i] > max_im)
         {
-            ptr_data_out[i] = max_range;
+            data_out[i] = max_range;
             continue;
         }
         if (data[i] < min_im)
         {
-            ptr_data_out[i] = min_range;
+            data_out[i] = min_range;
             continue;
         }
-        ptr_data_out[i] = slope * (data[i] - min_im) + min_range;
+        data_out[i] = slope * (data[i] - min_im) + min_range;
     }
-    return data_out;
 }
 
+void balance_simplest_limits(const double* data, int n, double sleft, double sright, double* scratch, double* min_im, double* max_im)
+{
+    int end_left = (int)(sleft / 100 * n + 1);
+    int end_right = (int)((100 - sright) / 100 * n);
+    int k_lo = std::min(end_left, end_right) - 1;
+    int k_hi = std::max(end_left, end_right) - 1;
+    int begin = 0;
+
+    std::copy(data, data + n, scratch);
+    if (k_lo >= 0 && k_lo < n)
+    {
+        std::nth_element(scratch, scratch + k_lo, scratch + n);
+        // the elements after k_lo are not smaller than scratch[k_lo]
+        begin = k_lo + 1;
+    }
+    if (k_hi != k_lo && k_hi >= 0 && k_hi < n)
+    {
+        std::nth_element(scratch + begin, scratch + k_hi, scratch + n);
+    }
+    *min_im = end_left >= 1 && end_left <= n ? scratch[end_left - 1] : NA_REAL;
+    *max_im = end_right >= 1 && end_right <= n ? scratch[end_right - 1] : NA_REAL;
+}
+
+void balance_simplest_apply(const double* data, double* data_out, int n, double sleft, double sright, double max_range, double min_range, double* scratch)
+{
+    double min_im, max_im;
+    balance_simplest_limits(data, n, sleft, sright, scratch, &min_im, &max_im);
+    saturate(data, data_out, n, max_im, min_im, max_range, min_range);
+}
+
+// [[Rcpp::export]]
+Rcpp::NumericVector balance_simplest(Rcpp::NumericVector data, double sleft, double sright, double max_range, double min_range)
+{
+    int n = data.size();
+    Rcpp::NumericVector data_out(n);
+    std::vector<double> scratch(n);
+    balance_simplest_apply(data.begin(), data_out.begin(), n, sleft, sright, max_range, min_range, n > 0 ? &scratch[0] : NULL);
+    return data_out;
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2011 Catalina Sbert <catalina.sbert@uib.es>
+ * All rights reserved
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGEREXTRA_SIMPLEST_COLOR_BALANCE_H
+#define IMAGEREXTRA_SIMPLEST_COLOR_BALANCE_H
+
+// Saturate data to [min_im, max_im] and stretch it linearly to [min_range, max_range].
+// data and data_out may be the same.
+void saturate(const double* data, double* data_out, int n, double max_im, double min_im, double max_range, double min_range);
+
+// Find min_im and max_im of Simplest Color Balance: the values of the
+// as.integer(sleft / 100 * n + 1)-th and as.integer((100 - sright) / 100 * n)-th
+// smallest elements of data, as BalanceSimplest did by sorting data.
+// They are found by selection in O(n) instead. scratch holds n doubles.
+// NA_REAL is returned for an order out of [1,n].
+void balance_simplest_limits(const double* data, int n, double sleft, double sright, double* scratch, double* min_im, double* max_im);
+
+// Simplest Color Balance of data into data_out. data and data_out may be the same.
+void balance_simplest_apply(const double* data, double* data_out, int n, double sleft, double sright, double max_range, double min_range, double* scratch);
+
+#endif
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2018, Shota Ochi <shotaochi1990@gmail.com>
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGEREXTRA_THRESHOLDING_OBJECTIVES_H
+#define IMAGEREXTRA_THRESHOLDING_OBJECTIVES_H
+
+#include "entropy_kernels.h"
+
+// Objective functions of the histogram-based thresholding functions.
+// They are written as branch-free loops over contiguous arrays, and the
+// logarithms are computed by the kernels of entropy_kernels.h.
+
+// fuzzy entropy of the S-function membership with the parameters interval[idx_a] and interval[idx_c]
+// (fuzzy_thresholding.cpp)
+double calc_fuzzy_entropy(const entropy_kernel& kernel, const double* imhist, const double* interval, int idx_a, int idx_c);
+
+// integral_plogp[j] = sum_{i <= j} p_i log p_i (multilevel_thresholding.cpp)
+void make_integral_plogp_multilevel(const entropy_kernel& kernel, const double* density, int n, double* integral_plogp);
+
+// entropy of the k thresholds in O(k). work must have 2 * (k + 1) doubles. (multilevel_thresholding.cpp)
+double calculate_entropy_multilevel(const entropy_kernel& kernel, const double* density, const double* integral_density, const double* integral_plogp, int n, const int* thresholds, int k, double* work);
+
+// index of the threshold maximizing the interclass variance of Otsu's method.
+// work must have 3 * n + 2 doubles. (iterative_triclass_thresholding.cpp)
+int calc_threshold_otsu(const double* prob, const double* bins, int n, double* work);
+
+#endif